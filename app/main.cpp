@@ -0,0 +1,268 @@
+// Standalone module server.
+//
+// Runs the module server of a config with a service implementation loaded
+// from a shared library through the C ABI of swapit/service_plugin.h. No
+// Python interpreter is involved, so a call costs the conversion of its
+// arguments and one call through a function pointer.
+#include <dlfcn.h>
+
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "module_config.h"
+#include "swapit/module_server.h"
+#include "swapit/service_plugin.h"
+
+namespace swapit {
+namespace {
+
+struct Options {
+    std::string config;
+    // Overrides "service_library" of the config if not empty
+    std::string library;
+    // Overrides the number of workers of the config if not 0
+    size_t workers = 0;
+    bool to_registry = false;
+};
+
+void
+print_usage() {
+    std::cerr << "Usage: swapit-module-server <config.json> [--library=PATH]\n"
+                 "       [--workers=N] [--registry]\n";
+}
+
+// Upper bound of --workers
+constexpr unsigned long max_workers = 1024;
+
+size_t
+parse_workers(const char *v) {
+    errno = 0;
+    char *end = nullptr;
+    // strtoul skips whitespace and negates a leading '-', so a digit must come
+    // first.
+    unsigned long n = std::isdigit(static_cast<unsigned char>(*v))
+                          ? std::strtoul(v, &end, 10)
+                          : 0;
+    if(!end || *end != '\0' || errno == ERANGE || n == 0 || n > max_workers) {
+        throw std::invalid_argument("--workers must be an integer from 1 to " +
+                                    std::to_string(max_workers) + ".");
+    }
+    return n;
+}
+
+Options
+parse_options(int argc, char **argv) {
+    Options o;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const std::string &name) -> const char * {
+            const std::string prefix = "--" + name + "=";
+            return arg.compare(0, prefix.size(), prefix) == 0 ? argv[i] + prefix.size()
+                                                               : nullptr;
+        };
+        if(const char *v = value("library")) {
+            o.library = v;
+        } else if(const char *v = value("workers")) {
+            o.workers = parse_workers(v);
+        } else if(arg == "--registry") {
+            o.to_registry = true;
+        } else if(arg.compare(0, 2, "--") != 0 && o.config.empty()) {
+            o.config = arg;
+        } else {
+            throw std::invalid_argument("Unknown argument: " + arg);
+        }
+    }
+    if(o.config.empty()) {
+        throw std::invalid_argument("Invalid arguments.");
+    }
+    return o;
+}
+
+// Returns the library of the config, relative to the directory of the config.
+std::string
+library_of_config(const std::string &json_file) {
+    const json::Value config = read_config(json_file);
+    const json::Value *library = config.find("service_library");
+    if(!library) {
+        throw std::invalid_argument(
+            "No service library given and \"service_library\" missing in " + json_file +
+            ".");
+    }
+    std::filesystem::path path = library->string();
+    if(path.is_relative()) {
+        path = std::filesystem::absolute(json_file).parent_path() / path;
+    }
+    return path.string();
+}
+
+// result
+
+std::optional<PfdlVariant> &
+result_of(swapit_result *result) {
+    return *static_cast<std::optional<PfdlVariant> *>(result->context);
+}
+
+void
+set_boolean(swapit_result *result, int value) {
+    result_of(result) = value != 0;
+}
+
+void
+set_number(swapit_result *result, double value) {
+    result_of(result) = value;
+}
+
+// A null string clears the result, which fails the call.
+void
+set_string(swapit_result *result, const char *data, size_t length) {
+    if(!data) {
+        result_of(result).reset();
+        return;
+    }
+    result_of(result) = std::string(data, length);
+}
+
+// plugin
+
+swapit_string
+to_swapit_string(std::string_view s) {
+    return {s.data(), s.size()};
+}
+
+swapit_argument
+to_swapit_argument(const ArgumentView &arg) {
+    swapit_argument a = {};
+    a.name = to_swapit_string(arg.name);
+    if(const bool *b = std::get_if<bool>(&arg.value)) {
+        a.type = SWAPIT_BOOLEAN;
+        a.value.boolean = *b;
+    } else if(const double *d = std::get_if<double>(&arg.value)) {
+        a.type = SWAPIT_NUMBER;
+        a.value.number = *d;
+    } else {
+        a.type = SWAPIT_STRING;
+        a.value.string = to_swapit_string(std::get<std::string_view>(arg.value));
+    }
+    return a;
+}
+
+struct LibraryCloser {
+    void
+    operator()(void *library) const noexcept {
+        dlclose(library);
+    }
+};
+
+// A service implementation loaded from a shared library. Must outlive the
+// module server calling it.
+class ServicePlugin {
+  public:
+    ServicePlugin(const std::string &path, const std::string &json_file,
+                  const std::string &service_name)
+        : library_(dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL)) {
+        if(!library_) {
+            throw std::runtime_error("Failed to load " + path + ": " + dlerror() + ".");
+        }
+        auto get_service = reinterpret_cast<swapit_get_service_v1_fn>(
+            dlsym(library_.get(), SWAPIT_GET_SERVICE_V1));
+        if(!get_service) {
+            throw std::runtime_error(path +
+                                     " does not export " SWAPIT_GET_SERVICE_V1 ".");
+        }
+        service_ = get_service();
+        if(!service_ || service_->abi_version != SWAPIT_SERVICE_ABI_VERSION ||
+           !service_->call) {
+            throw std::runtime_error(path + " provides no valid swapit_service_v1.");
+        }
+        if(service_->create) {
+            state_ = service_->create(json_file.c_str(), service_name.c_str());
+            if(!state_) {
+                throw std::runtime_error("Failed to create service " + service_name +
+                                         " of " + path + ".");
+            }
+        }
+    }
+
+    ~ServicePlugin() {
+        if(service_->destroy) {
+            service_->destroy(state_);
+        }
+    }
+
+    ServicePlugin(const ServicePlugin &) = delete;
+    ServicePlugin &
+    operator=(const ServicePlugin &) = delete;
+
+    // Called by the workers, possibly concurrently.
+    std::optional<PfdlVariant>
+    operator()(const std::vector<ArgumentView> &args) const {
+        // Services rarely take more arguments, so a call needs no allocation.
+        constexpr size_t inline_arguments = 8;
+        std::array<swapit_argument, inline_arguments> inline_args;
+        std::vector<swapit_argument> heap_args;
+        swapit_argument *out = inline_args.data();
+        if(args.size() > inline_arguments) {
+            heap_args.resize(args.size());
+            out = heap_args.data();
+        }
+        for(size_t i = 0; i < args.size(); ++i) {
+            out[i] = to_swapit_argument(args[i]);
+        }
+
+        std::optional<PfdlVariant> value;
+        swapit_result result = {&value, set_boolean, set_number, set_string};
+        if(service_->call(state_, out, args.size(), &result) != 0) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+  private:
+    // Keep member order! The library is unloaded last.
+    std::unique_ptr<void, LibraryCloser> library_;
+    const swapit_service_v1 *service_ = nullptr;
+    void *state_ = nullptr;
+};
+
+int
+run(const Options &o) {
+    ModuleDescription descr = read_module_description(o.config);
+    if(o.workers != 0) {
+        descr.workers = o.workers;
+    }
+    ServiceDescription &service = descr.services.front();
+    const std::string library =
+        o.library.empty() ? library_of_config(o.config) : o.library;
+    auto plugin = std::make_shared<ServicePlugin>(library, o.config, service.name);
+    service.callback = [plugin](const std::vector<ArgumentView> &args) {
+        return (*plugin)(args);
+    };
+
+    bool ok = run_module_server(std::move(descr), o.config, o.to_registry, true);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+}  // namespace
+}  // namespace swapit
+
+int
+main(int argc, char **argv) {
+    try {
+        return swapit::run(swapit::parse_options(argc, argv));
+    } catch(const std::invalid_argument &e) {
+        std::cerr << e.what() << std::endl;
+        swapit::print_usage();
+    } catch(const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+    return EXIT_FAILURE;
+}
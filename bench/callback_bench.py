@@ -0,0 +1,74 @@
+"""Per-call overhead of invoking a Python service callback from C++.
+
+Compares a wrapper like the former one, which takes a kwargs dict and checks
+the result in Python, with the callbacks bound by bind_callback, which pass the
+arguments positionally or by keyword with a single vectorcall.
+"""
+
+import argparse
+import traceback
+
+from swapit_module_server.module_server import (
+    Parameter,
+    PfdlType,
+    PfdlTypes,
+    ServiceDescription,
+)
+from swapit_module_server._module_server_impl import benchmark_callback, bind_callback
+
+
+def create_service() -> ServiceDescription:
+    service = ServiceDescription()
+    service.name = "BenchService"
+    service.input_params = [
+        Parameter("flag", PfdlType.boolean),
+        Parameter("amount", PfdlType.number),
+        Parameter("part", PfdlType.string),
+    ]
+    service.output_param = Parameter("result", PfdlType.boolean)
+    return service
+
+
+def kwargs_wrapper(callback):
+    def cb_wrapper(**kwargs):
+        try:
+            result = callback(**kwargs)
+            if not isinstance(result, PfdlTypes):
+                raise ValueError(f"Return type must be an instance of: {PfdlTypes}")
+            return result
+        except Exception:
+            traceback.print_exc()
+            return None
+
+    return cb_wrapper
+
+
+def positional(flag: bool, amount: float, part: str) -> bool:
+    return flag
+
+
+def keywords(**kwargs) -> bool:
+    return kwargs["flag"]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--iterations", type=int, default=200000)
+    args = parser.parse_args()
+    values = [True, 42.0, "an argument of a typical length"]
+
+    for name, callback in [("positional", positional), ("keywords", keywords)]:
+        service = create_service()
+        bind_callback(service, kwargs_wrapper(callback))
+        before = benchmark_callback(service, values, args.iterations)
+        service = create_service()
+        bind_callback(service, callback)
+        after = benchmark_callback(service, values, args.iterations)
+        print(
+            f"{name}: kwargs wrapper {before * 1e6:.2f} us, "
+            f"bind_callback {after * 1e6:.2f} us per call"
+        )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,356 @@
+// Microbenchmarks of the service dispatch path.
+//
+// The internals of the module server live in an anonymous namespace of a
+// single translation unit, which is compiled into the benchmark.
+#include "module_server.cpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <deque>
+
+// Counts heap allocations to report them per iteration.
+static std::atomic<size_t> allocations = 0;
+
+void *
+operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void
+operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace swapit {
+namespace {
+
+// Reports the heap allocations done between construction and destruction.
+class AllocationCounter {
+  public:
+    explicit AllocationCounter(benchmark::State &state)
+        : state_(state), start_(allocations.load(std::memory_order_relaxed)) {}
+
+    ~AllocationCounter() {
+        state_.counters["allocs"] = benchmark::Counter(
+            static_cast<double>(allocations.load(std::memory_order_relaxed) - start_),
+            benchmark::Counter::kAvgIterations);
+    }
+
+  private:
+    benchmark::State &state_;
+    size_t start_;
+};
+
+struct ServerDeleter {
+    void
+    operator()(UA_Server *server) const noexcept {
+        UA_Server_delete(server);
+    }
+};
+
+using ServerPtr = std::unique_ptr<UA_Server, ServerDeleter>;
+
+ServerPtr
+create_server(Namespaces &ns) {
+    ServerPtr server(UA_Server_new());
+    ns = add_namespaces(server.get(), "http://swap.demo.scenarios.fraunhofer.de/bench");
+    return server;
+}
+
+// Owns the data referenced by the variants.
+struct Inputs {
+    std::deque<std::string> string_values;
+    std::deque<UA_PfdlBoolean> booleans;
+    std::deque<UA_PfdlNumber> numbers;
+    std::deque<UA_PfdlString> strings;
+    std::vector<UA_Variant> variants;
+    std::vector<Parameter> params;
+};
+
+void
+add_input(Inputs &in, const std::string &name, const PfdlVariant &value) {
+    UA_Variant v = {};
+    PfdlType type = get_type(value);
+    switch(type) {
+        case PfdlType::boolean:
+            in.booleans.push_back({std::get<bool>(value)});
+            UA_Variant_setScalar(&v, &in.booleans.back(), get_struct_data_type(type));
+            break;
+        case PfdlType::number:
+            in.numbers.push_back({std::get<double>(value)});
+            UA_Variant_setScalar(&v, &in.numbers.back(), get_struct_data_type(type));
+            break;
+        case PfdlType::string:
+            in.string_values.push_back(std::get<std::string>(value));
+            in.strings.push_back({ua_string(in.string_values.back())});
+            UA_Variant_setScalar(&v, &in.strings.back(), get_struct_data_type(type));
+            break;
+    }
+    in.variants.push_back(v);
+    in.params.push_back({name, type});
+}
+
+const std::string bench_string = "an argument of a typical length";
+
+Inputs
+create_inputs() {
+    Inputs in;
+    add_input(in, "flag", true);
+    add_input(in, "amount", 42.0);
+    add_input(in, "part", bench_string);
+    return in;
+}
+
+// convert_arguments / to_view / CallArguments
+
+// Validation of a call, which does not copy the request.
+void
+BM_convert_arguments(benchmark::State &state) {
+    Inputs in = create_inputs();
+    std::vector<PfdlValueView> values;
+    AllocationCounter counter(state);
+    for(auto _ : state) {
+        convert_arguments(in.variants.data(), in.variants.size(), in.params, values);
+        benchmark::DoNotOptimize(values.data());
+    }
+}
+BENCHMARK(BM_convert_arguments);
+
+// Validation and the copy of an accepted call
+void
+BM_convert_arguments_pooled(benchmark::State &state) {
+    Inputs in = create_inputs();
+    std::vector<PfdlValueView> values;
+    ArgumentPool pool(default_queue_capacity);
+    AllocationCounter counter(state);
+    for(auto _ : state) {
+        convert_arguments(in.variants.data(), in.variants.size(), in.params, values);
+        ArgumentPool::Handle args = pool.acquire();
+        args->assign(in.params, values);
+        benchmark::DoNotOptimize(args->views().data());
+    }
+}
+BENCHMARK(BM_convert_arguments_pooled);
+
+void
+BM_to_view(benchmark::State &state) {
+    Inputs in = create_inputs();
+    const size_t i = static_cast<size_t>(state.range(0));
+    PfdlValueView out;
+    for(auto _ : state) {
+        bool ok = to_view(&in.variants[i], in.params[i].type, out);
+        benchmark::DoNotOptimize(ok);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetLabel(in.params[i].name);
+}
+BENCHMARK(BM_to_view)->DenseRange(0, 2);
+
+// create_sync_result
+
+void
+BM_create_sync_result(benchmark::State &state) {
+    const std::string msg =
+        "Queue depth: 0, estimated wait: 0 ms. Executing async Service.";
+    for(auto _ : state) {
+        UA_Variant v = create_sync_result(msg, UA_STATUSCODE_GOOD, 1.5);
+        benchmark::DoNotOptimize(v.data);
+        UA_Variant_clear(&v);
+    }
+}
+BENCHMARK(BM_create_sync_result);
+
+// ServiceStore::find, the fallback for methods without node context
+
+void
+BM_service_store_find(benchmark::State &state) {
+    const auto size = static_cast<UA_UInt32>(state.range(0));
+    WorkerPool workers(1);
+    CompletionQueue completions(nullptr);
+    TaskTracker tasks;
+    ServiceContext context{workers, completions, tasks};
+    ServiceStore store;
+    for(UA_UInt32 i = 0; i < size; ++i) {
+        store.add({UA_NODEID_NUMERIC(2, 50000 + i),
+                   std::make_unique<AsyncService>(context, 1, 0)});
+    }
+    UA_UInt32 i = 0;
+    for(auto _ : state) {
+        const UA_NodeId id = UA_NODEID_NUMERIC(2, 50000 + i);
+        benchmark::DoNotOptimize(store.find(id));
+        i = i + 1 == size ? 0 : i + 1;
+    }
+}
+BENCHMARK(BM_service_store_find)->Arg(1)->Arg(16)->Arg(256);
+
+// DurationEstimator::value, evaluated for every call
+
+void
+BM_duration_estimator_value(benchmark::State &state) {
+    DurationEstimator estimator;
+    for(int i = 0; i < 100; ++i) {
+        estimator.add(std::chrono::microseconds(1000 + (i * 37) % 500));
+    }
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(estimator.value());
+    }
+}
+BENCHMARK(BM_duration_estimator_value);
+
+// Invalid calls
+
+// A client sending arguments of the wrong type. Invalid calls are rejected
+// by status, compare with BM_invalid_call_exception for the former rejection
+// by exception.
+void
+BM_invalid_call(benchmark::State &state) {
+    Namespaces ns;
+    ServerPtr server = create_server(ns);
+    Inputs in = create_inputs();
+    WorkerPool workers(1);
+    CompletionQueue completions(nullptr);
+    TaskTracker tasks;
+    ServiceContext context{workers, completions, tasks};
+    ServiceDescription descr;
+    descr.name = "BenchService";
+    descr.input_params = in.params;
+    std::swap(descr.input_params[0], descr.input_params[1]);
+    descr.output_param = {"result", PfdlType::boolean};
+    auto service = AsyncService::create(server.get(), ns, descr, context);
+    for(auto _ : state) {
+        UA_Variant v;
+        (*service)(in.variants.data(), in.variants.size(), &v);
+        benchmark::DoNotOptimize(v.data);
+        UA_Variant_clear(&v);
+    }
+}
+BENCHMARK(BM_invalid_call);
+
+// Baseline of BM_invalid_call: the rejection as it was before it returned a
+// status. The failed validation threw BadStatusError, which the method
+// callback caught to write the result.
+void
+BM_invalid_call_exception(benchmark::State &state) {
+    Inputs in = create_inputs();
+    std::vector<Parameter> params = in.params;
+    std::swap(params[0], params[1]);
+    std::vector<PfdlValueView> values;
+    for(auto _ : state) {
+        std::stringstream msg;
+        UA_StatusCode status = UA_STATUSCODE_GOOD;
+        try {
+            throw_if_bad(convert_arguments(in.variants.data(), in.variants.size(),
+                                           params, values));
+            msg << "Executing async Service.";
+        } catch(const BadStatusError &e) {
+            status = e.status();
+            msg << "Execution failed with Status: " << e.what() << ".";
+        }
+        UA_Variant v = create_sync_result(msg.str(), status);
+        benchmark::DoNotOptimize(v.data);
+        UA_Variant_clear(&v);
+    }
+}
+BENCHMARK(BM_invalid_call_exception);
+
+void
+BM_bad_status_exception(benchmark::State &state) {
+    for(auto _ : state) {
+        UA_StatusCode status = UA_STATUSCODE_GOOD;
+        try {
+            throw_if_bad(UA_STATUSCODE_BADINVALIDARGUMENT);
+        } catch(const BadStatusError &e) {
+            status = e.status();
+        }
+        benchmark::DoNotOptimize(status);
+    }
+}
+BENCHMARK(BM_bad_status_exception);
+
+// Queue
+
+// Each thread enqueues before it dequeues, so wait_dequeue never blocks for
+// good.
+void
+BM_queue_enqueue_dequeue(benchmark::State &state) {
+    static Queue<Task> *queue;
+    if(state.thread_index() == 0) {
+        queue = new Queue<Task>(default_queue_capacity);
+    }
+    AllocationCounter counter(state);
+    for(auto _ : state) {
+        queue->try_enqueue([] {});
+        auto task = queue->wait_dequeue();
+        benchmark::DoNotOptimize(task);
+    }
+    if(state.thread_index() == 0) {
+        delete queue;
+    }
+}
+BENCHMARK(BM_queue_enqueue_dequeue)->ThreadRange(1, 8)->UseRealTime();
+
+// Baseline for the queue above
+void
+BM_mutex_queue_enqueue_dequeue(benchmark::State &state) {
+    static std::mutex mutex;
+    static std::condition_variable cv;
+    static std::queue<std::function<void()>> queue;
+    AllocationCounter counter(state);
+    for(auto _ : state) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push([] {});
+        }
+        cv.notify_one();
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [] { return !queue.empty(); });
+        auto task = std::move(queue.front());
+        queue.pop();
+        benchmark::DoNotOptimize(task);
+    }
+}
+BENCHMARK(BM_mutex_queue_enqueue_dequeue)->ThreadRange(1, 8)->UseRealTime();
+
+// Time from handing a task to an idle worker until the submitter learns that
+// it ran.
+void
+BM_worker_pool_round_trip(benchmark::State &state) {
+    WorkerPool workers(1);
+    Semaphore done;
+    AllocationCounter counter(state);
+    for(auto _ : state) {
+        workers.try_enqueue({[&done] { done.signal(); }, nullptr});
+        done.wait();
+    }
+}
+BENCHMARK(BM_worker_pool_round_trip)->UseRealTime();
+
+// ServiceEvent::emit
+
+void
+BM_service_event_emit(benchmark::State &state) {
+    Namespaces ns;
+    ServerPtr server = create_server(ns);
+    ServiceEvent event = ServiceEvent::create(
+        server.get(), ns, "BenchServiceFinishedEvent", {"result", PfdlType::string});
+    const std::optional<PfdlVariant> result = PfdlVariant(bench_string);
+    for(auto _ : state) {
+        event.emit(server.get(), result);
+    }
+}
+BENCHMARK(BM_service_event_emit);
+
+}  // namespace
+}  // namespace swapit
+
+BENCHMARK_MAIN();
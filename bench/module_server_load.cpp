@@ -0,0 +1,726 @@
+// Load generator for a module server.
+//
+// Starts the module server of a config in this process, calls its service
+// from several client sessions at a target rate and measures the latency from
+// each call to the ServiceFinishedEvent. Everything runs on loopback and the
+// module is not registered, so no device registry is needed.
+//
+// ServiceFinishedEvents do not identify the call they belong to. Events are
+// therefore matched to the oldest accepted call without event, which is exact
+// as long as the service finishes calls in order.
+#include <open62541/client.h>
+#include <open62541/client_config_default.h>
+#include <open62541/client_highlevel.h>
+#include <open62541/client_subscriptions.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nodesets/types_common_generated.h>
+#include <nodesets/types_pfdl_generated.h>
+
+#include "module_config.h"
+#include "swapit/module_server.h"
+
+namespace swapit {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void
+check(UA_StatusCode status, const std::string &what) {
+    if(UA_StatusCode_isBad(status)) {
+        throw std::runtime_error(what + " failed with Status: " +
+                                 UA_StatusCode_name(status));
+    }
+}
+
+struct Options {
+    std::string config;
+    std::string endpoint;
+    size_t sessions = 4;
+    // Target rate of all sessions together in calls/s
+    double rate = 100.0;
+    double duration = 10.0;
+    // Run time of the service callback in ms
+    double work = 0.0;
+    // Overrides the number of workers of the config if not 0
+    size_t workers = 0;
+    // Calls a server that is already running instead of starting one
+    bool external = false;
+    // Fails the run if the median latency from call to event is larger, if
+    // not 0. Used as test of the server loop.
+    double max_latency = 0.0;
+};
+
+void
+print_usage() {
+    std::cerr << "Usage: module_server_load <config.json> [--sessions=N]\n"
+                 "       [--rate=CALLS_PER_S] [--duration=S] [--work=MS] [--workers=N]\n"
+                 "       [--endpoint=URL] [--external] [--max-latency=MS]\n";
+}
+
+Options
+parse_options(int argc, char **argv) {
+    Options o;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const std::string &name) -> const char * {
+            const std::string prefix = "--" + name + "=";
+            return arg.compare(0, prefix.size(), prefix) == 0 ? argv[i] + prefix.size()
+                                                               : nullptr;
+        };
+        if(const char *v = value("sessions")) {
+            o.sessions = std::max<size_t>(std::strtoul(v, nullptr, 10), 1);
+        } else if(const char *v = value("rate")) {
+            o.rate = std::strtod(v, nullptr);
+        } else if(const char *v = value("duration")) {
+            o.duration = std::strtod(v, nullptr);
+        } else if(const char *v = value("work")) {
+            o.work = std::strtod(v, nullptr);
+        } else if(const char *v = value("workers")) {
+            o.workers = std::strtoul(v, nullptr, 10);
+        } else if(const char *v = value("max-latency")) {
+            o.max_latency = std::strtod(v, nullptr);
+        } else if(const char *v = value("endpoint")) {
+            o.endpoint = v;
+        } else if(arg == "--external") {
+            o.external = true;
+        } else if(arg.compare(0, 2, "--") != 0 && o.config.empty()) {
+            o.config = arg;
+        } else {
+            throw std::invalid_argument("Unknown argument: " + arg);
+        }
+    }
+    if(o.config.empty() || o.rate <= 0.0 || o.duration <= 0.0) {
+        throw std::invalid_argument("Invalid arguments.");
+    }
+    return o;
+}
+
+// client
+
+using ClientPtr = std::unique_ptr<UA_Client, decltype(&UA_Client_delete)>;
+
+ClientPtr
+connect(const std::string &endpoint) {
+    // Decode the results of the service calls
+    static const UA_DataTypeArray pfdl_types = {NULL, UA_TYPES_PFDL_COUNT, UA_TYPES_PFDL};
+    static const UA_DataTypeArray common_types = {&pfdl_types, UA_TYPES_COMMON_COUNT,
+                                                  UA_TYPES_COMMON};
+
+    // The server may still be starting up.
+    const auto deadline = Clock::now() + std::chrono::seconds(10);
+    while(true) {
+        ClientPtr client(UA_Client_new(), &UA_Client_delete);
+        UA_ClientConfig *config = UA_Client_getConfig(client.get());
+        check(UA_ClientConfig_setDefault(config), "Configuring the client");
+        config->customDataTypes = &common_types;
+        UA_StatusCode status = UA_Client_connect(client.get(), endpoint.c_str());
+        if(status == UA_STATUSCODE_GOOD) {
+            return client;
+        }
+        if(Clock::now() > deadline) {
+            check(status, "Connecting to " + endpoint);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+class OwnedNodeId {
+  public:
+    OwnedNodeId() = default;
+
+    explicit OwnedNodeId(const UA_NodeId &id) {
+        check(UA_NodeId_copy(&id, &id_), "Copying a NodeId");
+    }
+
+    ~OwnedNodeId() {
+        UA_NodeId_clear(&id_);
+    }
+
+    OwnedNodeId(OwnedNodeId &&other) noexcept : id_(other.id_) {
+        UA_NodeId_init(&other.id_);
+    }
+
+    OwnedNodeId &
+    operator=(OwnedNodeId &&other) noexcept {
+        std::swap(id_, other.id_);
+        return *this;
+    }
+
+    const UA_NodeId &
+    get() const noexcept {
+        return id_;
+    }
+
+  private:
+    UA_NodeId id_ = {};
+};
+
+struct ServiceNodes {
+    OwnedNodeId object_id;
+    OwnedNodeId method_id;
+};
+
+// Searches the objects below the Objects folder for the service method.
+ServiceNodes
+find_service(UA_Client *client, const std::string &service_name) {
+    std::deque<OwnedNodeId> objects;
+    objects.emplace_back(UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER));
+    while(!objects.empty()) {
+        OwnedNodeId parent = std::move(objects.front());
+        objects.pop_front();
+
+        UA_BrowseDescription bd;
+        UA_BrowseDescription_init(&bd);
+        bd.nodeId = parent.get();
+        bd.browseDirection = UA_BROWSEDIRECTION_FORWARD;
+        bd.referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES);
+        bd.includeSubtypes = true;
+        bd.resultMask = UA_BROWSERESULTMASK_ALL;
+
+        UA_BrowseRequest request;
+        UA_BrowseRequest_init(&request);
+        request.nodesToBrowse = &bd;
+        request.nodesToBrowseSize = 1;
+
+        UA_BrowseResponse response = UA_Client_Service_browse(client, request);
+        std::unique_ptr<UA_BrowseResponse, decltype(&UA_BrowseResponse_clear)> guard(
+            &response, &UA_BrowseResponse_clear);
+        check(response.responseHeader.serviceResult, "Browsing");
+        for(size_t i = 0; i < response.resultsSize; ++i) {
+            const UA_BrowseResult &result = response.results[i];
+            for(size_t j = 0; j < result.referencesSize; ++j) {
+                const UA_ReferenceDescription &ref = result.references[j];
+                const UA_String &name = ref.browseName.name;
+                if(ref.nodeClass == UA_NODECLASS_METHOD &&
+                   std::string(name.data, name.data + name.length) == service_name) {
+                    return {std::move(parent), OwnedNodeId(ref.nodeId.nodeId)};
+                }
+                // Skip the address space of the server itself
+                if(ref.nodeClass == UA_NODECLASS_OBJECT &&
+                   ref.nodeId.nodeId.namespaceIndex != 0) {
+                    objects.emplace_back(ref.nodeId.nodeId);
+                }
+            }
+        }
+    }
+    throw std::runtime_error("Service " + service_name + " not found.");
+}
+
+// measurements
+
+struct Samples {
+    std::vector<double> values;
+
+    void
+    merge(const Samples &other) {
+        values.insert(values.end(), other.values.begin(), other.values.end());
+    }
+
+    double
+    percentile(double p) {
+        if(values.empty()) {
+            return 0.0;
+        }
+        std::sort(values.begin(), values.end());
+        size_t i = static_cast<size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+        return values[i];
+    }
+};
+
+double
+to_ms(UA_DateTime d) {
+    return static_cast<double>(d) / UA_DATETIME_MSEC;
+}
+
+// Accepted calls that still wait for their event
+class PendingCalls {
+  public:
+    uint64_t
+    add(UA_DateTime sent) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        calls_.emplace(next_, sent);
+        return next_++;
+    }
+
+    void
+    remove(uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        calls_.erase(id);
+    }
+
+    // Returns false if no call is pending.
+    bool
+    take_oldest(UA_DateTime &sent) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(calls_.empty()) {
+            return false;
+        }
+        sent = calls_.begin()->second;
+        calls_.erase(calls_.begin());
+        return true;
+    }
+
+    size_t
+    size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return calls_.size();
+    }
+
+  private:
+    mutable std::mutex mutex_;
+    std::map<uint64_t, UA_DateTime> calls_;
+    uint64_t next_ = 0;
+};
+
+// Receives the ServiceFinishedEvents on its own session.
+class EventListener {
+  public:
+    EventListener(const std::string &endpoint, PendingCalls &pending)
+        : client_(connect(endpoint)), pending_(pending) {
+        UA_CreateSubscriptionRequest request = UA_CreateSubscriptionRequest_default();
+        // Revised to the fastest interval the server supports
+        request.requestedPublishingInterval = 0.0;
+        UA_CreateSubscriptionResponse response =
+            UA_Client_Subscriptions_create(client_.get(), request, NULL, NULL, NULL);
+        check(response.responseHeader.serviceResult, "Creating the subscription");
+        publishing_interval_ = response.revisedPublishingInterval;
+
+        UA_QualifiedName fields[2] = {UA_QUALIFIEDNAME(0, (char *)"Time"),
+                                      UA_QUALIFIEDNAME(0, (char *)"EventType")};
+        UA_SimpleAttributeOperand select[2];
+        for(size_t i = 0; i < 2; ++i) {
+            UA_SimpleAttributeOperand_init(&select[i]);
+            select[i].typeDefinitionId = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEEVENTTYPE);
+            select[i].browsePathSize = 1;
+            select[i].browsePath = &fields[i];
+            select[i].attributeId = UA_ATTRIBUTEID_VALUE;
+        }
+        UA_EventFilter filter;
+        UA_EventFilter_init(&filter);
+        filter.selectClausesSize = 2;
+        filter.selectClauses = select;
+
+        UA_MonitoredItemCreateRequest item;
+        UA_MonitoredItemCreateRequest_init(&item);
+        item.itemToMonitor.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER);
+        item.itemToMonitor.attributeId = UA_ATTRIBUTEID_EVENTNOTIFIER;
+        item.monitoringMode = UA_MONITORINGMODE_REPORTING;
+        item.requestedParameters.filter.encoding = UA_EXTENSIONOBJECT_DECODED;
+        item.requestedParameters.filter.content.decoded.data = &filter;
+        item.requestedParameters.filter.content.decoded.type =
+            &UA_TYPES[UA_TYPES_EVENTFILTER];
+        item.requestedParameters.queueSize = 100000;
+        item.requestedParameters.discardOldest = false;
+
+        UA_MonitoredItemCreateResult result = UA_Client_MonitoredItems_createEvent(
+            client_.get(), response.subscriptionId, UA_TIMESTAMPSTORETURN_NEITHER, item,
+            this, &EventListener::on_event, NULL);
+        check(result.statusCode, "Monitoring the events");
+
+        thread_ = std::thread([this] {
+            while(!stop_) {
+                UA_Client_run_iterate(client_.get(), 10);
+            }
+        });
+    }
+
+    ~EventListener() {
+        stop();
+    }
+
+    EventListener(const EventListener &) = delete;
+    EventListener &
+    operator=(const EventListener &) = delete;
+
+    void
+    stop() {
+        if(thread_.joinable()) {
+            stop_ = true;
+            thread_.join();
+            UA_Client_disconnect(client_.get());
+        }
+    }
+
+    double
+    publishing_interval() const noexcept {
+        return publishing_interval_;
+    }
+
+    // Must only be called after stop().
+    Samples &
+    emitted() {
+        return emitted_;
+    }
+
+    Samples &
+    received() {
+        return received_;
+    }
+
+    uint64_t
+    events() const noexcept {
+        return events_;
+    }
+
+  private:
+    static void
+    on_event(UA_Client *client, UA_UInt32 sub_id, void *sub_context, UA_UInt32 mon_id,
+             void *mon_context, size_t n_fields, UA_Variant *fields) {
+        auto *self = static_cast<EventListener *>(mon_context);
+        if(n_fields != 2 ||
+           !UA_Variant_hasScalarType(&fields[0], &UA_TYPES[UA_TYPES_DATETIME]) ||
+           !UA_Variant_hasScalarType(&fields[1], &UA_TYPES[UA_TYPES_NODEID])) {
+            return;
+        }
+        // ServiceFinishedEvent types live in the namespace of the module.
+        if(static_cast<UA_NodeId *>(fields[1].data)->namespaceIndex == 0) {
+            return;
+        }
+        UA_DateTime now = UA_DateTime_now();
+        UA_DateTime time = *static_cast<UA_DateTime *>(fields[0].data);
+        UA_DateTime sent;
+        if(!self->pending_.take_oldest(sent)) {
+            return;
+        }
+        ++self->events_;
+        self->emitted_.values.push_back(to_ms(time - sent));
+        self->received_.values.push_back(to_ms(now - sent));
+    }
+
+  private:
+    ClientPtr client_;
+    PendingCalls &pending_;
+    double publishing_interval_ = 0.0;
+    Samples emitted_;
+    Samples received_;
+    std::atomic<uint64_t> events_ = 0;
+    std::atomic<bool> stop_ = false;
+    std::thread thread_;
+};
+
+// Owns the data referenced by the input arguments.
+struct Inputs {
+    std::deque<UA_PfdlBoolean> booleans;
+    std::deque<UA_PfdlNumber> numbers;
+    std::deque<UA_PfdlString> strings;
+    std::vector<UA_Variant> variants;
+};
+
+Inputs
+create_inputs(const std::vector<Parameter> &params) {
+    Inputs in;
+    for(const auto &p : params) {
+        UA_Variant v = {};
+        switch(p.type) {
+            case PfdlType::boolean:
+                in.booleans.push_back({true});
+                UA_Variant_setScalar(&v, &in.booleans.back(),
+                                     &UA_TYPES_PFDL[UA_TYPES_PFDL_PFDLBOOLEAN]);
+                break;
+            case PfdlType::number:
+                in.numbers.push_back({1.0});
+                UA_Variant_setScalar(&v, &in.numbers.back(),
+                                     &UA_TYPES_PFDL[UA_TYPES_PFDL_PFDLNUMBER]);
+                break;
+            case PfdlType::string:
+                in.strings.push_back({UA_STRING((char *)"load")});
+                UA_Variant_setScalar(&v, &in.strings.back(),
+                                     &UA_TYPES_PFDL[UA_TYPES_PFDL_PFDLSTRING]);
+                break;
+        }
+        in.variants.push_back(v);
+    }
+    return in;
+}
+
+struct SessionResult {
+    uint64_t sent = 0;
+    // Calls whose result follows as event
+    uint64_t accepted = 0;
+    // Sync calls answered with their result
+    uint64_t completed = 0;
+    uint64_t rejected = 0;
+    uint64_t failed = 0;
+    Samples round_trip;
+
+    void
+    merge(const SessionResult &other) {
+        sent += other.sent;
+        accepted += other.accepted;
+        completed += other.completed;
+        rejected += other.rejected;
+        failed += other.failed;
+        round_trip.merge(other.round_trip);
+    }
+};
+
+enum class CallOutcome { accepted, completed, rejected, failed };
+
+CallOutcome
+async_call_outcome(UA_StatusCode status, size_t output_size, const UA_Variant *output) {
+    const UA_DataType *result_type =
+        &UA_TYPES_COMMON[UA_TYPES_COMMON_SERVICEEXECUTIONASYNCRESULTDATATYPE];
+    if(status != UA_STATUSCODE_GOOD || output_size != 1 ||
+       !UA_Variant_hasScalarType(&output[0], result_type)) {
+        return CallOutcome::failed;
+    }
+    const auto *result =
+        static_cast<const UA_ServiceExecutionAsyncResultDataType *>(output[0].data);
+    return result->serviceTriggerResult == UA_SERVICETRIGGERRESULT_SERVICE_RESULT_ACCEPTED
+               ? CallOutcome::accepted
+               : CallOutcome::rejected;
+}
+
+// The serviceResultCode decides: with GoodCompletesAsynchronously the result
+// follows as event and the serviceExecutionStatus has no meaning.
+CallOutcome
+sync_call_outcome(UA_StatusCode status, size_t output_size, const UA_Variant *output) {
+    const UA_DataType *result_type =
+        &UA_TYPES_COMMON[UA_TYPES_COMMON_SERVICEEXECUTIONSYNCRESULTDATATYPE];
+    if(status != UA_STATUSCODE_GOOD || output_size != 2 ||
+       !UA_Variant_hasScalarType(&output[0], result_type)) {
+        return CallOutcome::failed;
+    }
+    const auto *result =
+        static_cast<const UA_ServiceExecutionSyncResultDataType *>(output[0].data);
+    switch(static_cast<UA_StatusCode>(result->serviceResultCode)) {
+        case UA_STATUSCODE_GOOD:
+            return result->serviceExecutionStatus ==
+                           UA_SERVICEEXECUTIONSTATUS_SERVICE_EXECUTION_SUCCESS
+                       ? CallOutcome::completed
+                       : CallOutcome::failed;
+        case UA_STATUSCODE_GOODCOMPLETESASYNCHRONOUSLY:
+            return CallOutcome::accepted;
+        case UA_STATUSCODE_BADRESOURCEUNAVAILABLE:
+            return CallOutcome::rejected;
+        default:
+            return CallOutcome::failed;
+    }
+}
+
+// Calls the service at a fixed rate until stop is set.
+SessionResult
+run_session(const std::string &endpoint, const ServiceDescription &descr, double rate,
+            PendingCalls &pending, const std::atomic<bool> &stop) {
+    ClientPtr client = connect(endpoint);
+    ServiceNodes service = find_service(client.get(), descr.name);
+    Inputs in = create_inputs(descr.input_params);
+    const auto outcome_of = descr.execution == ServiceExecution::sync
+                                ? &sync_call_outcome
+                                : &async_call_outcome;
+
+    SessionResult r;
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / rate));
+    auto next = Clock::now();
+    while(!stop) {
+        std::this_thread::sleep_until(next);
+        next += interval;
+
+        UA_DateTime sent = UA_DateTime_now();
+        uint64_t id = pending.add(sent);
+        size_t output_size = 0;
+        UA_Variant *output = nullptr;
+        UA_StatusCode status = UA_Client_call(
+            client.get(), service.object_id.get(), service.method_id.get(),
+            in.variants.size(), in.variants.data(), &output_size, &output);
+        r.round_trip.values.push_back(to_ms(UA_DateTime_now() - sent));
+        ++r.sent;
+
+        switch(outcome_of(status, output_size, output)) {
+            case CallOutcome::accepted:
+                ++r.accepted;
+                break;
+            case CallOutcome::completed:
+                pending.remove(id);
+                ++r.completed;
+                break;
+            case CallOutcome::rejected:
+                pending.remove(id);
+                ++r.rejected;
+                break;
+            case CallOutcome::failed:
+                pending.remove(id);
+                ++r.failed;
+                break;
+        }
+        UA_Array_delete(output, output_size, &UA_TYPES[UA_TYPES_VARIANT]);
+    }
+    UA_Client_disconnect(client.get());
+    return r;
+}
+
+void
+print_latencies(const std::string &name, Samples &s) {
+    std::cout << std::left << std::setw(26) << name << std::right << std::fixed
+              << std::setprecision(3) << " p50 " << std::setw(9) << s.percentile(0.5)
+              << " p90 " << std::setw(9) << s.percentile(0.9) << " p99 " << std::setw(9)
+              << s.percentile(0.99) << " max " << std::setw(9) << s.percentile(1.0)
+              << std::endl;
+}
+
+void
+print_latencies(const std::string &name, const LatencySummary &s) {
+    std::cout << std::left << std::setw(26) << name << std::right << std::fixed
+              << std::setprecision(3) << " p50 " << std::setw(9) << s.p50 << " p90 "
+              << std::setw(9) << s.p90 << " p99 " << std::setw(9) << s.p99 << " max "
+              << std::setw(9) << s.max << std::endl;
+}
+
+std::string
+default_endpoint(const std::string &config_file) {
+    const json::Value config = read_config(config_file);
+    const json::Value *port = config.find("port");
+    if(!port) {
+        return "opc.tcp://localhost:4840";
+    }
+    if(std::holds_alternative<double>(port->data)) {
+        return "opc.tcp://localhost:" + std::to_string(static_cast<int>(port->number()));
+    }
+    return "opc.tcp://localhost:" + port->string();
+}
+
+int
+run(const Options &o) {
+    ModuleDescription descr = read_module_description(o.config);
+    if(o.workers != 0) {
+        descr.workers = o.workers;
+    }
+    const ServiceDescription &service = descr.services.front();
+    const PfdlType output_type = service.output_param.type;
+    const auto work = std::chrono::duration<double, std::milli>(o.work);
+    descr.services.front().callback =
+        [output_type, work](
+            const std::vector<ArgumentView> &) -> std::optional<PfdlVariant> {
+        if(work.count() > 0.0) {
+            std::this_thread::sleep_for(work);
+        }
+        switch(output_type) {
+            case PfdlType::boolean:
+                return true;
+            case PfdlType::number:
+                return 1.0;
+            case PfdlType::string:
+                return std::string("done");
+        }
+        return std::nullopt;
+    };
+
+    const std::string endpoint =
+        o.endpoint.empty() ? default_endpoint(o.config) : o.endpoint;
+    std::optional<ModuleServerHandle> server;
+    if(!o.external) {
+        server.emplace(descr, o.config, false);
+        server->start();
+        if(!server->wait_until_running(10000.0)) {
+            std::cerr << "Module server failed to start." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    PendingCalls pending;
+    EventListener listener(endpoint, pending);
+
+    std::atomic<bool> stop = false;
+    std::mutex mutex;
+    SessionResult total;
+    std::vector<std::thread> sessions;
+    for(size_t i = 0; i < o.sessions; ++i) {
+        sessions.emplace_back([&] {
+            try {
+                SessionResult r =
+                    run_session(endpoint, service,
+                                o.rate / static_cast<double>(o.sessions), pending, stop);
+                std::lock_guard<std::mutex> lock(mutex);
+                total.merge(r);
+            } catch(const std::exception &e) {
+                std::cerr << "Session failed: " << e.what() << std::endl;
+            }
+        });
+    }
+
+    const auto start = Clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(o.duration));
+    stop = true;
+    for(auto &t : sessions) {
+        t.join();
+    }
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Wait for the events of the calls still running
+    const auto drain_deadline = Clock::now() + std::chrono::seconds(10);
+    while(pending.size() > 0 && Clock::now() < drain_deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    listener.stop();
+    if(server) {
+        server->stop();
+        server->wait();
+    }
+
+    std::cout << "sessions: " << o.sessions << ", target rate: " << o.rate
+              << " calls/s, duration: " << elapsed << " s" << std::endl;
+    std::cout << "calls: " << total.sent << " sent, " << total.accepted << " accepted, "
+              << total.completed << " completed sync, " << total.rejected
+              << " rejected, " << total.failed << " failed" << std::endl;
+    const uint64_t events = listener.events();
+    std::cout << "events: " << events << ", lost: " << pending.size() << std::endl;
+    std::cout << std::fixed << std::setprecision(1)
+              << "throughput: " << static_cast<double>(total.sent) / elapsed
+              << " calls/s, " << static_cast<double>(events) / elapsed << " events/s"
+              << std::endl;
+    std::cout << "latencies [ms], publishing interval " << listener.publishing_interval()
+              << " ms" << std::endl;
+    print_latencies("call round trip", total.round_trip);
+    print_latencies("call -> event", listener.emitted());
+    print_latencies("call -> notification", listener.received());
+    if(server) {
+        for(const auto &s : server->statistics()) {
+            print_latencies(s.name + " queue wait", s.queue_wait);
+            print_latencies(s.name + " run time", s.run_time);
+            print_latencies(s.name + " event delay", s.event_delay);
+            print_latencies(s.name + " event emission", s.event_emission);
+        }
+    }
+    if(o.max_latency > 0.0) {
+        const double median = listener.emitted().percentile(0.5);
+        if(events == 0 || median > o.max_latency) {
+            std::cerr << "Median latency from call to event " << median
+                      << " ms exceeds " << o.max_latency << " ms." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return total.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+}  // namespace
+}  // namespace swapit
+
+int
+main(int argc, char **argv) {
+    try {
+        return swapit::run(swapit::parse_options(argc, argv));
+    } catch(const std::invalid_argument &e) {
+        std::cerr << e.what() << std::endl;
+        swapit::print_usage();
+    } catch(const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,23 @@
+import os
+import time
+
+import swapit_module_server
+
+
+# CPU-bound callback: runs for about speed ms of pure Python
+def callback(order: str, speed: float, plot: bool) -> bool:
+    deadline = time.process_time() + speed / 1000.0
+    n = 0
+    while time.process_time() < deadline:
+        n += 1
+    return n > 0
+
+
+working_dir = os.path.dirname(__file__)
+config1 = os.path.join(working_dir, "config1.json")
+
+# run the callbacks in one worker process per core, call the service from
+# several clients at once, e.g. with bench/module_server_load, and watch the
+# worker processes use one core each
+if __name__ == "__main__":
+    swapit_module_server.run(config1, callback, False, processes=os.cpu_count())
@@ -1,5 +1,4 @@
 import os
-from threading import Thread
 
 import swapit_module_server
 
@@ -20,9 +19,6 @@ working_dir = os.path.dirname(__file__)
 config1 = os.path.join(working_dir, "config1.json")
 config2 = os.path.join(working_dir, "config2.json")
 
-t1 = Thread(target=swapit_module_server.run, args=(config1, callback1, True))
-t2 = Thread(target=swapit_module_server.run, args=(config2, callback2, True))
-t1.start()
-t2.start()
-t1.join()
-t2.join()
+# run both module servers in this process, sharing one server loop thread and
+# a pool of two worker threads
+swapit_module_server.run_host([(config1, callback1), (config2, callback2)], True, 2)
@@ -0,0 +1,27 @@
+/* Service implementation for config1.json, run without Python by
+ *
+ *     swapit-module-server examples/config1.json \
+ *         --library=build/examples/libnative_service.so
+ */
+#include <swapit/service_plugin.h>
+
+/* Fails calls with an empty string argument and returns true otherwise. Calls
+ * run on the workers, so nothing is printed per call. */
+static int
+call(void *state, const swapit_argument *args, size_t size, swapit_result *result) {
+    (void)state;
+    for(size_t i = 0; i < size; ++i) {
+        if(args[i].type == SWAPIT_STRING && args[i].value.string.length == 0) {
+            return 1;
+        }
+    }
+    result->set_boolean(result, 1);
+    return 0;
+}
+
+static const swapit_service_v1 service = {SWAPIT_SERVICE_ABI_VERSION, NULL, call, NULL};
+
+SWAPIT_PLUGIN_EXPORT const swapit_service_v1 *
+swapit_get_service_v1(void) {
+    return &service;
+}
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -17,29 +20,184 @@ struct Parameter {
     PfdlType type;
 };
 
-struct Argument {
-    std::string name;
-    PfdlVariant value;
+using PfdlValueView = std::variant<bool, double, std::string_view>;
+
+// Argument of a service call. The name and string values point into memory
+// owned by the module server and are only valid during the callback.
+struct ArgumentView {
+    std::string_view name;
+    PfdlValueView value;
 };
 
 using ServiceCallback =
-    std::function<std::optional<PfdlVariant>(const std::vector<Argument> &args)>;
+    std::function<std::optional<PfdlVariant>(const std::vector<ArgumentView> &args)>;
+
+// Completes a call started by a DeferredCallback, from any thread. Only the
+// first completion counts. If all copies are destroyed before, the call
+// fails.
+class ServiceCompletion {
+  public:
+    class Impl;
+
+    explicit ServiceCompletion(std::shared_ptr<Impl> impl);
+
+    void
+    operator()(std::optional<PfdlVariant> result) const;
+
+  private:
+    std::shared_ptr<Impl> impl_;
+};
+
+// Starts a call and completes it later through done, so that no worker is
+// blocked while the call waits, e.g. for I/O. args are only valid during the
+// callback.
+using DeferredCallback =
+    std::function<void(const std::vector<ArgumentView> &args, ServiceCompletion done)>;
+
+// Processes several calls at once and returns one result per call.
+using BatchCallback = std::function<std::vector<std::optional<PfdlVariant>>(
+    const std::vector<std::vector<ArgumentView>> &batch)>;
+
+enum class ServiceExecution : int { async = 0, sync };
+
+// Upper bound of sync_budget in ms. A sync call blocks the server thread, and
+// with it every module the thread serves.
+constexpr double max_sync_budget = 50.0;
 
 struct ServiceDescription {
     std::string name;
     std::vector<Parameter> input_params;
     Parameter output_param;
     ServiceCallback callback;
+    // Maximum number of concurrent executions, 0 = unlimited
+    size_t max_concurrency = 1;
+    // Maximum number of calls waiting for execution, 0 = unlimited
+    size_t max_queue_depth = 0;
+    // sync: the method returns the result if it is ready within sync_budget,
+    // otherwise it follows as ServiceFinishedEvent like for async services.
+    // The serviceResultCode of the reply tells the cases apart: a call that
+    // exceeded the budget is answered with GoodCompletesAsynchronously, and
+    // its serviceExecutionStatus has no meaning.
+    ServiceExecution execution = ServiceExecution::async;
+    // Time in ms a sync call waits for its result, at most max_sync_budget
+    double sync_budget = 10.0;
+    // Replaces callback if set. max_concurrency limits the callbacks starting
+    // calls, not the calls in flight.
+    DeferredCallback deferred_callback;
+    // Replaces callback and deferred_callback if set
+    BatchCallback batch_callback;
+    // Maximum number of calls per batch, 0 = unlimited
+    size_t max_batch_size = 16;
+    // Time in us a batch waits for more calls after its first call arrived
+    size_t batch_timeout = 0;
 };
 
 struct ModuleDescription {
     std::string namespace_name;
     std::string type_name;
     std::vector<ServiceDescription> services;
+    // Number of worker threads executing the services
+    size_t workers = 1;
+};
+
+struct HostedModule {
+    ModuleDescription descr;
+    std::string json_file;
+    bool to_registry;
+};
+
+// Latencies in ms
+struct LatencySummary {
+    uint64_t count = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
 };
 
-void
-run_module_server(ModuleDescription descr, const std::string &json_file,
-                  bool to_registry);
+struct ServiceStatistics {
+    std::string name;
+    // Time from accepting a call until the callback starts
+    LatencySummary queue_wait;
+    // Run time of the callback
+    LatencySummary run_time;
+    // Time from the end of a call until its ServiceFinishedEvent is emitted
+    LatencySummary event_delay;
+    // Time needed to emit the ServiceFinishedEvent
+    LatencySummary event_emission;
+    // Accepted calls waiting for a worker
+    size_t queue_depth = 0;
+    // Calls whose callback is running or, for a deferred callback, has not
+    // completed yet
+    size_t in_flight = 0;
+};
+
+// Reads the module description from a config file of the server template.
+// The callbacks of the services are left empty. Throws std::runtime_error if
+// the config is invalid.
+ModuleDescription
+read_module_description(const std::string &json_file);
+
+// Runs a module server on the calling thread. If handle_signals is set, the
+// server stops on SIGINT or SIGTERM, otherwise it runs forever. Errors are
+// reported to stderr. Returns false if the server failed.
+bool
+run_module_server(ModuleDescription descr, const std::string &json_file, bool to_registry,
+                  bool handle_signals = false);
+
+// Runs several module servers in one process. All servers share one thread
+// for their server loops and one worker pool of the given size. While a sync
+// service waits for its result, no hosted module answers requests. Returns
+// false if the servers failed.
+bool
+run_module_host(std::vector<HostedModule> modules, size_t workers,
+                bool handle_signals = false);
+
+// Controls a module server running on a background thread.
+class ModuleServerHandle {
+  public:
+    ModuleServerHandle(ModuleDescription descr, std::string json_file, bool to_registry,
+                       bool handle_signals = false);
+    // Stops the server and waits for it.
+    ~ModuleServerHandle();
+
+    ModuleServerHandle(ModuleServerHandle &&) noexcept;
+    ModuleServerHandle &
+    operator=(ModuleServerHandle &&) = delete;
+
+    // Starts the server thread. A stopped server may be started again after
+    // wait() returned. Throws std::logic_error if the server is running or
+    // the handle was moved from. On a moved-from handle, the other methods
+    // do nothing.
+    void
+    start();
+
+    // Requests the server to stop and returns immediately.
+    void
+    stop() noexcept;
+
+    // Blocks until the server thread has finished.
+    void
+    wait();
+
+    // Returns true while the server accepts calls.
+    bool
+    running() const noexcept;
+
+    // Blocks until the server accepts calls. Returns false if the server
+    // stopped or failed to start, or if the timeout in ms expired first.
+    bool
+    wait_until_running(double timeout);
+
+    // Statistics of the services since the last start. The queue depth and
+    // the calls in flight are read live. Empty until the server was started.
+    std::vector<ServiceStatistics>
+    statistics() const;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
 
 }  // namespace swapit
\ No newline at end of file
@@ -0,0 +1,78 @@
+/* C ABI of the service implementations loaded by swapit-module-server.
+ *
+ * A plugin is a shared library that exports
+ *
+ *     const swapit_service_v1 *swapit_get_service_v1(void);
+ *
+ * The returned descriptor must stay valid until the library is unloaded.
+ * Only types of this header cross the library boundary, so plugins may be
+ * built with another compiler or standard library than the server.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SWAPIT_SERVICE_ABI_VERSION 1
+#define SWAPIT_GET_SERVICE_V1 "swapit_get_service_v1"
+
+#if defined(_WIN32)
+#define SWAPIT_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define SWAPIT_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+/* Same values as swapit::PfdlType */
+typedef enum { SWAPIT_BOOLEAN = 0, SWAPIT_NUMBER = 1, SWAPIT_STRING = 2 } swapit_type;
+
+/* Strings are not null-terminated. */
+typedef struct {
+    const char *data;
+    size_t length;
+} swapit_string;
+
+typedef struct {
+    swapit_string name;
+    swapit_type type;
+    union {
+        int boolean;
+        double number;
+        swapit_string string;
+    } value;
+} swapit_argument;
+
+/* Receives the result of a call. The setters copy their arguments. Passing
+ * NULL as data of set_string fails the call. */
+typedef struct swapit_result {
+    void *context;
+    void (*set_boolean)(struct swapit_result *result, int value);
+    void (*set_number)(struct swapit_result *result, double value);
+    void (*set_string)(struct swapit_result *result, const char *data, size_t length);
+} swapit_result;
+
+typedef struct {
+    /* SWAPIT_SERVICE_ABI_VERSION the plugin was built with */
+    uint32_t abi_version;
+    /* Called once before the server starts, with the path of the config
+     * file and the name of the service. Returns the state passed to call,
+     * or NULL on failure. May be NULL if the plugin has no state. */
+    void *(*create)(const char *json_file, const char *service_name);
+    /* Called for every call of the service, by up to max_concurrency
+     * workers at the same time. The arguments are valid during the call
+     * only. Returns 0 and sets a result on success; any other value fails
+     * the call. */
+    int (*call)(void *state, const swapit_argument *args, size_t size,
+                swapit_result *result);
+    /* Called once after the server stopped. May be NULL. */
+    void (*destroy)(void *state);
+} swapit_service_v1;
+
+typedef const swapit_service_v1 *(*swapit_get_service_v1_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,14 +1,249 @@
 #include <nanobind/nanobind.h>
-#include <nanobind/stl/function.h>
 #include <nanobind/stl/optional.h>
 #include <nanobind/stl/string.h>
 #include <nanobind/stl/variant.h>
 #include <nanobind/stl/vector.h>
 #include <swapit/module_server.h>
 
+#include <array>
+#include <chrono>
+
 namespace nb = nanobind;
 using namespace swapit;
 
+#if PY_VERSION_HEX < 0x03090000
+#define PyObject_Vectorcall _PyObject_Vectorcall
+#endif
+
+namespace {
+
+// Returns true if the leading parameters of fn are the service parameters in
+// order and can be passed positionally.
+bool
+accepts_positional(nb::handle fn, const std::vector<Parameter> &params) {
+    try {
+        nb::module_ inspect = nb::module_::import_("inspect");
+        nb::object kind = inspect.attr("Parameter");
+        nb::object positional_only = kind.attr("POSITIONAL_ONLY");
+        nb::object positional_or_keyword = kind.attr("POSITIONAL_OR_KEYWORD");
+        size_t i = 0;
+        nb::object signature = inspect.attr("signature")(fn);
+        for(nb::handle p : signature.attr("parameters").attr("values")()) {
+            if(i == params.size()) {
+                break;
+            }
+            nb::object k = p.attr("kind");
+            if(!(k.equal(positional_only) || k.equal(positional_or_keyword)) ||
+               nb::cast<std::string>(p.attr("name")) != params[i].name) {
+                return false;
+            }
+            ++i;
+        }
+        return i == params.size();
+    } catch(const nb::python_error &) {
+        // No signature, e.g. for some builtins
+        return false;
+    }
+}
+
+// New reference to an owned copy of v, or nullptr with an exception set.
+PyObject *
+to_python(const PfdlValueView &v) {
+    if(const auto *b = std::get_if<bool>(&v)) {
+        PyObject *o = *b ? Py_True : Py_False;
+        Py_INCREF(o);
+        return o;
+    }
+    if(const auto *d = std::get_if<double>(&v)) {
+        return PyFloat_FromDouble(*d);
+    }
+    const auto &s = std::get<std::string_view>(v);
+    return PyUnicode_FromStringAndSize(s.data(), static_cast<Py_ssize_t>(s.size()));
+}
+
+// Copies the arguments of a call into a dict of Python values. The views point
+// into memory that is reused for later calls, so Python must not get them.
+nb::dict
+to_kwargs(const std::vector<ArgumentView> &args) {
+    nb::dict kwargs;
+    for(const auto &a : args) {
+        nb::object value = nb::steal(to_python(a.value));
+        if(!value.is_valid()) {
+            throw nb::python_error();
+        }
+        kwargs[nb::str(a.name.data(), a.name.size())] = value;
+    }
+    return kwargs;
+}
+
+// Holds a Python function for a std::function, which may be destroyed without
+// the GIL, so the reference is released under it.
+std::shared_ptr<nb::callable>
+share_function(nb::callable fn) {
+    return std::shared_ptr<nb::callable>(new nb::callable(std::move(fn)),
+                                         [](nb::callable *fn) {
+                                             nb::gil_scoped_acquire gil;
+                                             delete fn;
+                                         });
+}
+
+// Python function called through vectorcall, with the arguments converted
+// straight from the argument views. How they are passed is decided once
+// from the signature: positionally if possible, otherwise by keyword with a
+// prebuilt tuple of names. Neither way builds a dict per call.
+class CompiledCallback {
+  public:
+    CompiledCallback(nb::callable fn, const std::vector<Parameter> &params)
+        : fn_(std::move(fn)) {
+        if(!accepts_positional(fn_, params)) {
+            nb::list names;
+            for(const auto &p : params) {
+                names.append(nb::str(p.name.c_str(), p.name.size()));
+            }
+            kwnames_ = nb::tuple(names);
+        }
+    }
+
+    std::optional<PfdlVariant>
+    operator()(const std::vector<ArgumentView> &args) const {
+        nb::gil_scoped_acquire gil;
+        // argv[0] is free for the callee, see PY_VECTORCALL_ARGUMENTS_OFFSET.
+        std::array<PyObject *, 9> inline_argv;
+        std::vector<PyObject *> heap_argv;
+        PyObject **argv = inline_argv.data();
+        if(args.size() + 1 > inline_argv.size()) {
+            heap_argv.resize(args.size() + 1);
+            argv = heap_argv.data();
+        }
+        size_t converted = 0;
+        for(; converted < args.size(); ++converted) {
+            argv[converted + 1] = to_python(args[converted].value);
+            if(!argv[converted + 1]) {
+                break;
+            }
+        }
+
+        PyObject *result = nullptr;
+        if(converted == args.size()) {
+            size_t nargs = kwnames_.is_valid() ? 0 : args.size();
+            result = PyObject_Vectorcall(fn_.ptr(), argv + 1,
+                                         nargs | PY_VECTORCALL_ARGUMENTS_OFFSET,
+                                         kwnames_.ptr());
+        }
+        for(size_t i = 0; i < converted; ++i) {
+            Py_DECREF(argv[i + 1]);
+        }
+        if(!result) {
+            print_error();
+            return std::nullopt;
+        }
+        return to_result(nb::steal(result));
+    }
+
+  private:
+    // Prints and clears the raised exception. Unlike PyErr_Print, this does not
+    // exit the process on SystemExit, which fails the call only.
+    void
+    print_error() const {
+        PyErr_WriteUnraisable(fn_.ptr());
+    }
+
+    std::optional<PfdlVariant>
+    to_result(nb::handle o) const {
+        if(o.is_none()) {
+            return std::nullopt;
+        }
+        if(PyBool_Check(o.ptr())) {
+            return o.ptr() == Py_True;
+        }
+        if(PyFloat_Check(o.ptr())) {
+            return PyFloat_AsDouble(o.ptr());
+        }
+        if(PyUnicode_Check(o.ptr())) {
+            Py_ssize_t size;
+            if(const char *data = PyUnicode_AsUTF8AndSize(o.ptr(), &size)) {
+                return std::string(data, static_cast<size_t>(size));
+            }
+        } else {
+            PyErr_SetString(PyExc_ValueError,
+                            "Return type must be an instance of: None, bool, float, str");
+        }
+        print_error();
+        return std::nullopt;
+    }
+
+  private:
+    nb::object fn_;
+    // Set if the arguments are passed by keyword
+    nb::object kwnames_;
+};
+
+// Sets a CompiledCallback as callback of service. The std::function may be
+// destroyed without the GIL, so the references are released under it.
+void
+bind_callback(ServiceDescription &service, nb::callable fn) {
+    std::shared_ptr<CompiledCallback> cb(
+        new CompiledCallback(std::move(fn), service.input_params),
+        [](CompiledCallback *cb) {
+            nb::gil_scoped_acquire gil;
+            delete cb;
+        });
+    service.callback = [cb](const std::vector<ArgumentView> &args) {
+        return (*cb)(args);
+    };
+}
+
+// Sets fn(kwargs, done) as deferred callback of service.
+void
+bind_deferred_callback(ServiceDescription &service, nb::callable fn) {
+    service.deferred_callback = [fn = share_function(std::move(fn))](
+                                    const std::vector<ArgumentView> &args,
+                                    ServiceCompletion done) {
+        nb::gil_scoped_acquire gil;
+        (*fn)(to_kwargs(args), std::move(done));
+    };
+}
+
+// Sets fn(batch) as batch callback of service. fn takes a list with the kwargs
+// of each call and returns one result per call.
+void
+bind_batch_callback(ServiceDescription &service, nb::callable fn) {
+    service.batch_callback = [fn = share_function(std::move(fn))](
+                                 const std::vector<std::vector<ArgumentView>> &batch) {
+        nb::gil_scoped_acquire gil;
+        nb::list calls;
+        for(const auto &args : batch) {
+            calls.append(to_kwargs(args));
+        }
+        return nb::cast<std::vector<std::optional<PfdlVariant>>>((*fn)(calls));
+    };
+}
+
+// Average time in s of calling the callback of service from a thread without
+// the GIL, like a worker does.
+double
+benchmark_callback(const ServiceDescription &service,
+                   const std::vector<PfdlVariant> &values, size_t iterations) {
+    if(values.size() != service.input_params.size()) {
+        throw std::invalid_argument("Expected one value per input parameter.");
+    }
+    std::vector<ArgumentView> args;
+    for(size_t i = 0; i < values.size(); ++i) {
+        PfdlValueView value =
+            std::visit([](const auto &v) { return PfdlValueView(v); }, values[i]);
+        args.push_back({service.input_params[i].name, value});
+    }
+    nb::gil_scoped_release release;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < iterations; ++i) {
+        service.callback(args);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / static_cast<double>(std::max<size_t>(iterations, 1));
+}
+
+}  // namespace
+
 NB_MODULE(_module_server_impl, m) {
     nb::enum_<PfdlType>(m, "PfdlType")
         .value("number", PfdlType::number)
@@ -21,11 +256,13 @@ NB_MODULE(_module_server_impl, m) {
         .def_rw("name", &Parameter::name)
         .def_rw("type", &Parameter::type);
 
-    nb::class_<Argument>(m, "Argument")
-        .def(nb::init<>())
-        .def(nb::init<const std::string &, PfdlVariant>())
-        .def_rw("name", &Argument::name)
-        .def_rw("value", &Argument::value);
+    // Passed to deferred callbacks. Calling it completes the service call.
+    nb::class_<ServiceCompletion>(m, "ServiceCompletion")
+        .def("__call__", &ServiceCompletion::operator(), nb::arg("result").none());
+
+    nb::enum_<ServiceExecution>(m, "ServiceExecution")
+        .value("async_", ServiceExecution::async)
+        .value("sync", ServiceExecution::sync);
 
     nb::class_<ServiceDescription>(m, "ServiceDescription")
         .def(nb::init<>())
@@ -37,7 +274,7 @@ NB_MODULE(_module_server_impl, m) {
         //     [](ServiceDescription &s, const ServiceCallback &cb) {
         //         s.callback =
         //             [cb = cb](
-        //                 const std::vector<Argument> &args) ->
+        //                 const std::vector<ArgumentView> &args) ->
         //                 std::optional<PfdlVariant> {
         //             try {
         //                 std::cout << "Hello" << std::endl;
@@ -53,15 +290,84 @@ NB_MODULE(_module_server_impl, m) {
         //             }
         //         };
         //     });
-        .def_rw("callback", &ServiceDescription::callback);
+        .def_rw("max_concurrency", &ServiceDescription::max_concurrency)
+        .def_rw("max_queue_depth", &ServiceDescription::max_queue_depth)
+        .def_rw("execution", &ServiceDescription::execution)
+        .def_rw("sync_budget", &ServiceDescription::sync_budget)
+        .def_rw("max_batch_size", &ServiceDescription::max_batch_size)
+        .def_rw("batch_timeout", &ServiceDescription::batch_timeout);
 
     nb::class_<ModuleDescription>(m, "ModuleDescription")
         .def(nb::init<>())
         .def_rw("namespace_name", &ModuleDescription::namespace_name)
         .def_rw("type_name", &ModuleDescription::type_name)
-        .def_rw("services", &ModuleDescription::services);
+        .def_rw("services", &ModuleDescription::services)
+        .def_rw("workers", &ModuleDescription::workers);
+
+    nb::class_<HostedModule>(m, "HostedModule")
+        .def(nb::init<>())
+        .def_rw("descr", &HostedModule::descr)
+        .def_rw("json_file", &HostedModule::json_file)
+        .def_rw("to_registry", &HostedModule::to_registry);
+
+    m.def("bind_callback", &bind_callback,
+          "Set a Python function as callback, which is called through vectorcall "
+          "according to its signature. input_params must be set before.",
+          nb::arg("service"), nb::arg("callback"));
+
+    m.def("bind_deferred_callback", &bind_deferred_callback,
+          "Set a Python function as deferred callback, which is called with a dict "
+          "of the arguments and the ServiceCompletion of the call.",
+          nb::arg("service"), nb::arg("callback"));
+
+    m.def("bind_batch_callback", &bind_batch_callback,
+          "Set a Python function as batch callback, which is called with a list of "
+          "dicts of the arguments and returns one result per call.",
+          nb::arg("service"), nb::arg("callback"));
+
+    m.def("benchmark_callback", &benchmark_callback,
+          "Average time in s of calling the callback of a service from a worker",
+          nb::arg("service"), nb::arg("values"), nb::arg("iterations"));
+
+    m.def("read_module_description", &read_module_description,
+          "Read the description of a module server from its config file",
+          nb::arg("json_file"));
 
     m.def("run_module_server", &run_module_server, "Run a module server",
           nb::arg("descr"), nb::arg("json_file"), nb::arg("to_registry"),
+          nb::arg("handle_signals") = false, nb::call_guard<nb::gil_scoped_release>());
+
+    m.def("run_module_host", &run_module_host,
+          "Run several module servers sharing one server loop and worker pool",
+          nb::arg("modules"), nb::arg("workers"), nb::arg("handle_signals") = false,
           nb::call_guard<nb::gil_scoped_release>());
+
+    nb::class_<LatencySummary>(m, "LatencySummary")
+        .def_ro("count", &LatencySummary::count)
+        .def_ro("mean", &LatencySummary::mean)
+        .def_ro("p50", &LatencySummary::p50)
+        .def_ro("p90", &LatencySummary::p90)
+        .def_ro("p99", &LatencySummary::p99)
+        .def_ro("max", &LatencySummary::max);
+
+    nb::class_<ServiceStatistics>(m, "ServiceStatistics")
+        .def_ro("name", &ServiceStatistics::name)
+        .def_ro("queue_wait", &ServiceStatistics::queue_wait)
+        .def_ro("run_time", &ServiceStatistics::run_time)
+        .def_ro("event_delay", &ServiceStatistics::event_delay)
+        .def_ro("event_emission", &ServiceStatistics::event_emission)
+        .def_ro("queue_depth", &ServiceStatistics::queue_depth)
+        .def_ro("in_flight", &ServiceStatistics::in_flight);
+
+    nb::class_<ModuleServerHandle>(m, "ModuleServerHandle")
+        .def(nb::init<ModuleDescription, std::string, bool, bool>(), nb::arg("descr"),
+             nb::arg("json_file"), nb::arg("to_registry"),
+             nb::arg("handle_signals") = false)
+        .def("start", &ModuleServerHandle::start)
+        .def("stop", &ModuleServerHandle::stop)
+        .def("wait", &ModuleServerHandle::wait, nb::call_guard<nb::gil_scoped_release>())
+        .def("running", &ModuleServerHandle::running)
+        .def("wait_until_running", &ModuleServerHandle::wait_until_running,
+             nb::arg("timeout"), nb::call_guard<nb::gil_scoped_release>())
+        .def("statistics", &ModuleServerHandle::statistics);
 }
\ No newline at end of file
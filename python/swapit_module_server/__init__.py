@@ -1 +1 @@
-from .module_server import run
+from .module_server import ModuleServer, run, run_host, start
@@ -3,56 +3,274 @@ from ._module_server_impl import (
     ModuleDescription,
     PfdlType,
     Parameter,
+    ServiceExecution,
+    HostedModule,
+    ModuleServerHandle,
+    ServiceStatistics,
+    bind_callback,
+    bind_deferred_callback,
+    bind_batch_callback,
+    read_module_description,
     run_module_server,
+    run_module_host,
 )
 
-import json
-from typing import Callable, Union
+import asyncio
+import inspect
+import threading
+from typing import Callable, List, Optional, Tuple, Union
 import traceback
 
+from .process_pool import ProcessPool
+
 PfdlTypes = Union[type(None), bool, float, str]
 
 ServiceCallable = Callable[..., PfdlTypes]
 
+# Takes the kwargs of several calls and returns one result per call
+BatchCallable = Callable[[List[dict]], List[PfdlTypes]]
+
 PFDL_TYPE_DICT = {
     "boolean": PfdlType.boolean,
     "number": PfdlType.number,
     "string": PfdlType.string,
 }
 
+_event_loop = None
+_event_loop_lock = threading.Lock()
+
+
+def get_event_loop() -> asyncio.AbstractEventLoop:
+    """Return the event loop running the async callbacks of this process.
+
+    The loop runs on a daemon thread that is started on first use.
+    """
+    global _event_loop
+    with _event_loop_lock:
+        if _event_loop is None:
+            _event_loop = asyncio.new_event_loop()
+            threading.Thread(
+                target=_event_loop.run_forever, name="swapit-asyncio", daemon=True
+            ).start()
+        return _event_loop
 
-def run(json_file: str, callback: ServiceCallable, to_registry: bool):
-    with open(json_file, "r") as f:
-        config = json.load(f)
 
-    def parse_params(p):
-        return [Parameter(n, PFDL_TYPE_DICT[t]) for n, t in p.items()]
+def create_module(
+    json_file: str,
+    callback: Union[ServiceCallable, BatchCallable],
+    batch: bool = False,
+    processes: int = 0,
+) -> ModuleDescription:
+    """Create the description of a module.
+
+    The worker processes of a callback with processes > 0 run until the
+    interpreter exits. ModuleServer stops them with the server instead.
+    """
+    return _create_module(json_file, callback, batch, processes)[0]
+
+
+def _create_module(
+    json_file: str,
+    callback: Union[ServiceCallable, BatchCallable],
+    batch: bool,
+    processes: int,
+) -> Tuple[ModuleDescription, Optional[ProcessPool]]:
+    # Also returns the process pool of the callback, if any. The config is
+    # read and validated by the same code as for the standalone server.
+    module = read_module_description(json_file)
+    service = module.services[0]
 
     def check_type(o):
         if not isinstance(o, PfdlTypes):
             raise ValueError(f"Return type must be an instance of: {PfdlTypes}")
         return o
 
-    def cb_wrapper(args):
+    def deferred_wrapper(kwargs, done):
         try:
-            kwargs = {a.name: a.value for a in args}
-            return check_type(callback(**kwargs))
+            future = asyncio.run_coroutine_threadsafe(
+                callback(**kwargs), get_event_loop()
+            )
         except Exception:
             traceback.print_exc()
-            return None
+            done(None)
+            return
+
+        def on_done(f):
+            try:
+                result = check_type(f.result())
+            except BaseException:
+                traceback.print_exc()
+                result = None
+            done(result)
 
-    service = ServiceDescription()
-    service.name = config["service_name"]
-    if len(config["input_params"]) < 1:
-        raise TypeError("Service must provide at least one input parameter")
+        future.add_done_callback(on_done)
 
-    service.input_params = parse_params(config["input_params"])
-    service.output_param = parse_params(config["output_param"])[0]
-    service.callback = cb_wrapper
+    def check_result(o):
+        try:
+            return check_type(o)
+        except ValueError:
+            traceback.print_exc()
+            return None
+
+    def batch_wrapper(batch):
+        try:
+            results = callback(batch)
+            # A result of the wrong type fails its call only.
+            return [check_result(r) for r in results]
+        except Exception:
+            traceback.print_exc()
+            return [None] * len(batch)
 
-    module = ModuleDescription()
-    module.type_name = config["module_type"]
-    module.namespace_name = config["namespace"]
+    pool = None
+    if processes > 0:
+        if batch or inspect.iscoroutinefunction(callback):
+            raise TypeError("Only plain callbacks can run in worker processes")
+        pool = ProcessPool(callback, [p.name for p in service.input_params], processes)
+        # The arguments are in the order of the input parameters.
+        bind_deferred_callback(
+            service, lambda kwargs, done: pool.submit(list(kwargs.values()), done)
+        )
+    elif batch:
+        if inspect.iscoroutinefunction(callback):
+            raise TypeError("Batch callbacks must not be async")
+        bind_batch_callback(service, batch_wrapper)
+    elif inspect.iscoroutinefunction(callback):
+        bind_deferred_callback(service, deferred_wrapper)
+    else:
+        bind_callback(service, callback)
+    # services holds copies, so the service with its callback is set again.
     module.services = [service]
+    return module, pool
+
+
+def run(
+    json_file: str,
+    callback: Union[ServiceCallable, BatchCallable],
+    to_registry: bool,
+    batch: bool = False,
+    processes: int = 0,
+):
+    """Run a module server until SIGINT or SIGTERM.
+
+    An async def callback runs on a shared asyncio event loop, so that many
+    calls can wait for I/O at the same time without blocking the workers.
+    With batch=True, callback receives a list with the kwargs of several
+    calls and returns a list with one result per call. With processes > 0,
+    callback runs in that many worker processes to use several cores.
+    Raises RuntimeError if the server failed; the error is printed to stderr.
+    """
+    module, pool = _create_module(json_file, callback, batch, processes)
+    try:
+        if not run_module_server(module, json_file, to_registry, handle_signals=True):
+            raise RuntimeError(f"The module server of {json_file} failed.")
+    finally:
+        if pool is not None:
+            pool.close()
+
+
+class ModuleServer:
+    """A module server running on a background thread.
+
+    start() returns once the server accepts calls and stop() returns once it
+    has stopped, so many servers can be run from one thread without signal
+    handlers. Used as a context manager, the server runs within the with
+    block. The callback arguments are the same as for run(); the worker
+    processes of processes > 0 run from construction until stop().
+    """
+
+    def __init__(
+        self,
+        json_file: str,
+        callback: Union[ServiceCallable, BatchCallable],
+        to_registry: bool = False,
+        batch: bool = False,
+        processes: int = 0,
+    ):
+        module, self._pool = _create_module(json_file, callback, batch, processes)
+        self._handle = ModuleServerHandle(module, json_file, to_registry)
+
+    def start(self, timeout: float = 10.0) -> "ModuleServer":
+        """Start the server and wait up to timeout seconds until it accepts calls."""
+        if self._pool is not None:
+            self._pool.start()
+        self._handle.start()
+        if not self._handle.wait_until_running(timeout * 1000.0):
+            self.stop()
+            raise RuntimeError("Module server failed to start")
+        return self
+
+    def stop(self):
+        """Stop the server, wait for its running calls and stop its processes."""
+        self._handle.stop()
+        self._handle.wait()
+        if self._pool is not None:
+            self._pool.close()
+
+    def wait(self):
+        """Block until the server has stopped."""
+        self._handle.wait()
+
+    @property
+    def running(self) -> bool:
+        return self._handle.running()
+
+    def statistics(self) -> List[ServiceStatistics]:
+        """Return the statistics of the services since the last start."""
+        return self._handle.statistics()
+
+    @property
+    def queue_depth(self) -> int:
+        """Number of accepted calls waiting for a worker."""
+        return sum(s.queue_depth for s in self._handle.statistics())
+
+    @property
+    def in_flight(self) -> int:
+        """Number of calls whose callback has not finished."""
+        return sum(s.in_flight for s in self._handle.statistics())
+
+    def __enter__(self) -> "ModuleServer":
+        return self.start()
+
+    def __exit__(self, *exc):
+        self.stop()
+
+    def __del__(self):
+        # Stops without holding the GIL, which running callbacks may need.
+        handle = getattr(self, "_handle", None)
+        if handle is not None:
+            self.stop()
+
+
+def start(
+    json_file: str,
+    callback: Union[ServiceCallable, BatchCallable],
+    to_registry: bool,
+    batch: bool = False,
+    processes: int = 0,
+) -> ModuleServer:
+    """Start a module server on a background thread.
+
+    Returns the running ModuleServer.
+    """
+    return ModuleServer(json_file, callback, to_registry, batch, processes).start()
+
+
+def run_host(
+    modules: List[Tuple[str, ServiceCallable]], to_registry: bool, workers: int = 1
+):
+    """Run several module servers in this process.
 
-    run_module_server(module, json_file, to_registry)
+    All servers share one thread for their server loops and a pool of
+    `workers` threads for the service callbacks. A sync service blocks every
+    hosted module for up to its sync_budget. Raises RuntimeError if the
+    servers failed.
+    """
+    hosted = []
+    for json_file, callback in modules:
+        m = HostedModule()
+        m.descr = create_module(json_file, callback)
+        m.json_file = json_file
+        m.to_registry = to_registry
+        hosted.append(m)
+    if not run_module_host(hosted, workers, handle_signals=True):
+        raise RuntimeError("The module host failed.")
@@ -0,0 +1,320 @@
+"""Execution of CPU-bound service callbacks in a pool of worker processes.
+
+Because of the GIL, the callbacks of one process can use a single core only.
+A ProcessPool starts warm worker processes once. Each worker has a shared
+memory slot through which it receives the arguments of a call and returns
+the result. Values are encoded in the order of the service parameters, so
+neither the kwargs nor the result are pickled, and the pipes to the workers
+only carry the length of a message.
+"""
+
+import atexit
+import multiprocessing
+import multiprocessing.connection
+import struct
+import threading
+import traceback
+from collections import deque
+from multiprocessing import shared_memory
+from typing import Callable, List, Optional, Sequence
+
+DEFAULT_SLOT_SIZE = 1 << 16
+
+_LENGTH = struct.Struct("<I")
+_BOOLEAN = struct.Struct("<c?")
+_NUMBER = struct.Struct("<cd")
+_STRING = struct.Struct("<cI")
+
+
+def encode(values: Sequence, buf: memoryview) -> int:
+    """Encode values into buf and return the number of bytes written."""
+    offset = 0
+
+    def reserve(size):
+        if offset + size > len(buf):
+            raise ValueError(f"Message exceeds the slot size of {len(buf)} bytes")
+
+    for v in values:
+        if v is None:
+            reserve(1)
+            buf[offset] = ord("n")
+            offset += 1
+        elif isinstance(v, bool):
+            reserve(_BOOLEAN.size)
+            _BOOLEAN.pack_into(buf, offset, b"?", v)
+            offset += _BOOLEAN.size
+        elif isinstance(v, float):
+            reserve(_NUMBER.size)
+            _NUMBER.pack_into(buf, offset, b"d", v)
+            offset += _NUMBER.size
+        elif isinstance(v, str):
+            data = v.encode()
+            reserve(_STRING.size + len(data))
+            _STRING.pack_into(buf, offset, b"s", len(data))
+            offset += _STRING.size
+            buf[offset : offset + len(data)] = data
+            offset += len(data)
+        else:
+            raise ValueError(f"Cannot encode a value of type {type(v).__name__}")
+    return offset
+
+
+def decode(buf: memoryview, length: int) -> list:
+    values = []
+    offset = 0
+    while offset < length:
+        tag = buf[offset]
+        if tag == ord("n"):
+            values.append(None)
+            offset += 1
+        elif tag == ord("?"):
+            values.append(_BOOLEAN.unpack_from(buf, offset)[1])
+            offset += _BOOLEAN.size
+        elif tag == ord("d"):
+            values.append(_NUMBER.unpack_from(buf, offset)[1])
+            offset += _NUMBER.size
+        elif tag == ord("s"):
+            size = _STRING.unpack_from(buf, offset)[1]
+            offset += _STRING.size
+            values.append(str(buf[offset : offset + size], "utf-8"))
+            offset += size
+        else:
+            raise ValueError(f"Invalid tag {tag} in message")
+    return values
+
+
+def _worker_main(callback, names, shm, conn):
+    buf = shm.buf
+    while True:
+        try:
+            message = conn.recv_bytes()
+        except EOFError:
+            break
+        if not message:
+            break
+        length = _LENGTH.unpack(message)[0]
+        try:
+            kwargs = dict(zip(names, decode(buf, length)))
+            length = encode([callback(**kwargs)], buf)
+        except Exception:
+            traceback.print_exc()
+            length = encode([None], buf)
+        conn.send_bytes(_LENGTH.pack(length))
+
+
+class _Worker:
+    def __init__(self, process, shm, conn):
+        self.process = process
+        self.shm = shm
+        self.conn = conn
+        # Completion of the call in progress
+        self.done = None
+        # Cleared when the worker was removed from the pool
+        self.alive = True
+
+
+class ProcessPool:
+    """Runs a callback in worker processes that are started once.
+
+    submit() hands the argument values of a call to an idle worker or queues
+    them, and calls done with the result from a reader thread. The workers
+    are forked from a forkserver process rather than from this process, so a
+    pool may be started while other threads run. The callback is therefore
+    pickled by reference: it must be a module-level function, and the main
+    module must be guarded by if __name__ == "__main__".
+    """
+
+    def __init__(
+        self,
+        callback: Callable,
+        names: List[str],
+        processes: int,
+        slot_size: int = DEFAULT_SLOT_SIZE,
+    ):
+        self._callback = callback
+        self._names = names
+        self._processes = max(processes, 1)
+        self._slot_size = slot_size
+        self._lock = threading.Lock()
+        # Workers that are alive
+        self._workers = []
+        self._all_workers = []
+        self._idle = []
+        self._pending = deque()
+        self._reader = None
+        self.start()
+
+    @property
+    def closed(self) -> bool:
+        return self._reader is None
+
+    def start(self):
+        """Start the workers of a new or closed pool."""
+        if not self.closed:
+            return
+        ctx = multiprocessing.get_context("forkserver")
+        workers = []
+        try:
+            for _ in range(self._processes):
+                shm = shared_memory.SharedMemory(create=True, size=self._slot_size)
+                conn, child_conn = ctx.Pipe()
+                process = ctx.Process(
+                    target=_worker_main,
+                    args=(self._callback, self._names, shm, child_conn),
+                    name="swapit-worker",
+                    daemon=True,
+                )
+                workers.append(_Worker(process, shm, conn))
+                process.start()
+                child_conn.close()
+        except BaseException:
+            self._stop_workers(workers)
+            raise
+        with self._lock:
+            self._workers = list(workers)
+            self._all_workers = workers
+            self._idle = list(workers)
+        self._wakeup, self._wakeup_sender = ctx.Pipe(duplex=False)
+        self._reader = threading.Thread(
+            target=self._read_results, name="swapit-process-pool", daemon=True
+        )
+        self._reader.start()
+        atexit.register(self.close)
+
+    def submit(self, values: list, done: Callable[[Optional[object]], None]):
+        with self._lock:
+            if not self._workers:
+                worker = None
+            elif self._idle:
+                worker = self._idle.pop()
+                worker.done = done
+            else:
+                self._pending.append((values, done))
+                return
+        if worker is None:
+            done(None)
+            return
+        self._dispatch(worker, values)
+
+    def close(self):
+        """Stop the workers and fail the calls that did not finish.
+
+        The pool may be started again afterwards.
+        """
+        if self.closed:
+            return
+        atexit.unregister(self.close)
+        self._wakeup_sender.send_bytes(b"")
+        self._reader.join()
+        self._reader = None
+        self._wakeup.close()
+        self._wakeup_sender.close()
+        with self._lock:
+            calls = [w.done for w in self._workers if w.done is not None]
+            calls += [d for _, d in self._pending]
+            for w in self._workers:
+                w.alive = False
+                w.done = None
+            workers, self._all_workers = self._all_workers, []
+            self._workers = []
+            self._idle = []
+            self._pending.clear()
+        self._stop_workers(workers)
+        for done in calls:
+            done(None)
+
+    @staticmethod
+    def _stop_workers(workers: List[_Worker]):
+        for w in workers:
+            try:
+                w.conn.send_bytes(b"")
+            except OSError:
+                pass
+        for w in workers:
+            if w.process.pid is not None:
+                w.process.join(timeout=1.0)
+                if w.process.is_alive():
+                    w.process.terminate()
+            w.conn.close()
+            w.shm.close()
+            w.shm.unlink()
+
+    def _dispatch(self, worker: _Worker, values: list):
+        # Sends values to worker, which the caller has taken from the idle
+        # list. Calls that cannot be encoded fail, then the next one is tried.
+        # If the worker died, the call is submitted again to another worker.
+        while True:
+            try:
+                length = encode(values, worker.shm.buf)
+            except Exception:
+                traceback.print_exc()
+            else:
+                try:
+                    worker.conn.send_bytes(_LENGTH.pack(length))
+                    return
+                except OSError:
+                    done, worker.done = worker.done, None
+                    self._remove(worker)
+                    self.submit(values, done)
+                    return
+            done, worker.done = worker.done, None
+            done(None)
+            values = self._next(worker)
+            if values is None:
+                return
+
+    def _next(self, worker: _Worker):
+        # Assigns the next pending call to worker and returns its values, or
+        # returns None and marks worker as idle unless it was removed.
+        with self._lock:
+            if not worker.alive:
+                return None
+            if self._pending:
+                values, worker.done = self._pending.popleft()
+                return values
+            self._idle.append(worker)
+            return None
+
+    def _read_results(self):
+        conns = {w.conn: w for w in self._workers}
+        while conns:
+            ready = multiprocessing.connection.wait(list(conns) + [self._wakeup])
+            for conn in ready:
+                if conn is self._wakeup:
+                    return
+                worker = conns[conn]
+                try:
+                    length = _LENGTH.unpack(conn.recv_bytes())[0]
+                except (EOFError, OSError):
+                    print(f"Worker process {worker.process.pid} died.")
+                    del conns[conn]
+                    self._remove(worker)
+                    continue
+                try:
+                    (result,) = decode(worker.shm.buf, length)
+                except Exception:
+                    traceback.print_exc()
+                    result = None
+                done, worker.done = worker.done, None
+                values = self._next(worker)
+                if values is not None:
+                    self._dispatch(worker, values)
+                done(result)
+
+    def _remove(self, worker: _Worker):
+        # Called when the pipe to worker broke, possibly twice.
+        with self._lock:
+            if not worker.alive:
+                return
+            worker.alive = False
+            self._workers.remove(worker)
+            if worker in self._idle:
+                self._idle.remove(worker)
+            done, worker.done = worker.done, None
+            pending = [] if self._workers else list(self._pending)
+            if not self._workers:
+                self._pending.clear()
+        if done is not None:
+            done(None)
+        for _, d in pending:
+            d(None)
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <locale>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace swapit {
+namespace json {
+
+// Minimal JSON reader for the config files of the server template.
+
+struct Value;
+
+using Array = std::vector<Value>;
+// Keeps the order of the keys, which defines the order of the service
+// parameters.
+using Object = std::vector<std::pair<std::string, Value>>;
+
+class TypeError : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+class ParseError : public std::runtime_error {
+  public:
+    ParseError(const std::string &what, size_t offset)
+        : std::runtime_error(what + " at offset " + std::to_string(offset) + "."),
+          offset_(offset) {}
+
+    size_t
+    offset() const noexcept {
+        return offset_;
+    }
+
+  private:
+    size_t offset_;
+};
+
+struct Value {
+    std::variant<std::nullptr_t, bool, double, std::string, Array, Object> data;
+
+    template <typename T>
+    const T &
+    get(const char *expected) const {
+        if(const T *v = std::get_if<T>(&data)) {
+            return *v;
+        }
+        throw TypeError(std::string("Expected ") + expected + ".");
+    }
+
+    bool
+    boolean() const {
+        return get<bool>("a boolean");
+    }
+
+    double
+    number() const {
+        return get<double>("a number");
+    }
+
+    const std::string &
+    string() const {
+        return get<std::string>("a string");
+    }
+
+    const Array &
+    array() const {
+        return get<Array>("an array");
+    }
+
+    const Object &
+    object() const {
+        return get<Object>("an object");
+    }
+
+    // Returns nullptr if the key does not exist.
+    const Value *
+    find(const std::string &key) const {
+        for(const auto &[k, v] : object()) {
+            if(k == key) {
+                return &v;
+            }
+        }
+        return nullptr;
+    }
+
+    const Value &
+    at(const std::string &key) const {
+        if(const Value *v = find(key)) {
+            return *v;
+        }
+        throw TypeError("Missing key \"" + key + "\".");
+    }
+};
+
+class Parser {
+  public:
+    explicit Parser(const std::string &text) : text_(text) {}
+
+    Value
+    parse() {
+        Value v = parse_value();
+        skip_whitespace();
+        if(pos_ != text_.size()) {
+            fail("Unexpected trailing characters");
+        }
+        return v;
+    }
+
+  private:
+    // Deeper nesting fails, so that the recursion cannot overflow the stack.
+    static constexpr size_t max_depth = 64;
+
+    [[noreturn]] void
+    fail(const std::string &what) const {
+        throw ParseError(what, pos_);
+    }
+
+    void
+    skip_whitespace() {
+        while(pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+                                      text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    char
+    peek() {
+        skip_whitespace();
+        if(pos_ == text_.size()) {
+            fail("Unexpected end of input");
+        }
+        return text_[pos_];
+    }
+
+    void
+    expect(char c) {
+        if(peek() != c) {
+            fail(std::string("Expected '") + c + "'");
+        }
+        ++pos_;
+    }
+
+    void
+    enter() {
+        if(++depth_ > max_depth) {
+            fail("Nesting too deep");
+        }
+    }
+
+    bool
+    consume(const char *literal) {
+        size_t n = std::char_traits<char>::length(literal);
+        if(text_.compare(pos_, n, literal) != 0) {
+            return false;
+        }
+        pos_ += n;
+        return true;
+    }
+
+    Value
+    parse_value() {
+        switch(peek()) {
+            case '{':
+                return {parse_object()};
+            case '[':
+                return {parse_array()};
+            case '"':
+                return {parse_string()};
+            default:
+                break;
+        }
+        if(consume("true")) {
+            return {true};
+        }
+        if(consume("false")) {
+            return {false};
+        }
+        if(consume("null")) {
+            return {nullptr};
+        }
+        return {parse_number()};
+    }
+
+    Object
+    parse_object() {
+        Object object;
+        expect('{');
+        enter();
+        if(peek() == '}') {
+            ++pos_;
+            --depth_;
+            return object;
+        }
+        do {
+            if(peek() != '"') {
+                fail("Expected a key");
+            }
+            std::string key = parse_string();
+            expect(':');
+            object.emplace_back(std::move(key), parse_value());
+        } while(peek() == ',' && ++pos_);
+        expect('}');
+        --depth_;
+        return object;
+    }
+
+    Array
+    parse_array() {
+        Array array;
+        expect('[');
+        enter();
+        if(peek() == ']') {
+            ++pos_;
+            --depth_;
+            return array;
+        }
+        do {
+            array.push_back(parse_value());
+        } while(peek() == ',' && ++pos_);
+        expect(']');
+        --depth_;
+        return array;
+    }
+
+    bool
+    is_digit() const {
+        return pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9';
+    }
+
+    // Returns false if there is no digit to skip.
+    bool
+    skip_digits() {
+        size_t begin = pos_;
+        while(is_digit()) {
+            ++pos_;
+        }
+        return pos_ != begin;
+    }
+
+    // Accepts the number grammar of JSON only, which strtod extends by hex
+    // numbers, inf, nan and leading '+' and '.'.
+    double
+    parse_number() {
+        const size_t begin = pos_;
+        consume("-");
+        if(!is_digit()) {
+            fail(pos_ == begin ? "Expected a value" : "Invalid number");
+        }
+        if(!consume("0")) {
+            skip_digits();
+        }
+        if(consume(".") && !skip_digits()) {
+            fail("Invalid number");
+        }
+        if(consume("e") || consume("E")) {
+            if(!consume("+")) {
+                consume("-");
+            }
+            if(!skip_digits()) {
+                fail("Invalid number");
+            }
+        }
+        // Unlike strtod, independent of the decimal point of the C locale
+        std::istringstream in(text_.substr(begin, pos_ - begin));
+        in.imbue(std::locale::classic());
+        double d = 0.0;
+        in >> d;
+        if(in.fail()) {
+            fail("Number out of range");
+        }
+        return d;
+    }
+
+    uint32_t
+    parse_hex4() {
+        if(pos_ + 4 > text_.size()) {
+            fail("Invalid unicode escape");
+        }
+        uint32_t cp = 0;
+        for(int i = 0; i < 4; ++i) {
+            char c = text_[pos_++];
+            cp <<= 4;
+            if(c >= '0' && c <= '9') {
+                cp |= static_cast<uint32_t>(c - '0');
+            } else if(c >= 'a' && c <= 'f') {
+                cp |= static_cast<uint32_t>(c - 'a' + 10);
+            } else if(c >= 'A' && c <= 'F') {
+                cp |= static_cast<uint32_t>(c - 'A' + 10);
+            } else {
+                fail("Invalid unicode escape");
+            }
+        }
+        return cp;
+    }
+
+    static void
+    append_utf8(std::string &s, uint32_t cp) {
+        if(cp < 0x80) {
+            s += static_cast<char>(cp);
+        } else if(cp < 0x800) {
+            s += static_cast<char>(0xC0 | (cp >> 6));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if(cp < 0x10000) {
+            s += static_cast<char>(0xE0 | (cp >> 12));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            s += static_cast<char>(0xF0 | (cp >> 18));
+            s += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    std::string
+    parse_string() {
+        expect('"');
+        std::string s;
+        while(true) {
+            if(pos_ == text_.size()) {
+                fail("Unterminated string");
+            }
+            char c = text_[pos_++];
+            if(c == '"') {
+                return s;
+            }
+            if(static_cast<unsigned char>(c) < 0x20) {
+                --pos_;
+                fail("Control character in string");
+            }
+            if(c != '\\') {
+                s += c;
+                continue;
+            }
+            if(pos_ == text_.size()) {
+                fail("Unterminated string");
+            }
+            switch(text_[pos_++]) {
+                case '"':
+                    s += '"';
+                    break;
+                case '\\':
+                    s += '\\';
+                    break;
+                case '/':
+                    s += '/';
+                    break;
+                case 'b':
+                    s += '\b';
+                    break;
+                case 'f':
+                    s += '\f';
+                    break;
+                case 'n':
+                    s += '\n';
+                    break;
+                case 'r':
+                    s += '\r';
+                    break;
+                case 't':
+                    s += '\t';
+                    break;
+                case 'u': {
+                    uint32_t cp = parse_hex4();
+                    if(cp >= 0xDC00 && cp < 0xE000) {
+                        fail("Lone surrogate");
+                    }
+                    // Combine surrogate pairs
+                    if(cp >= 0xD800 && cp < 0xDC00) {
+                        uint32_t low = consume("\\u") ? parse_hex4() : 0;
+                        if(low < 0xDC00 || low >= 0xE000) {
+                            fail("Lone surrogate");
+                        }
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    append_utf8(s, cp);
+                    break;
+                }
+                default:
+                    fail("Invalid escape sequence");
+            }
+        }
+    }
+
+  private:
+    const std::string &text_;
+    size_t pos_ = 0;
+    size_t depth_ = 0;
+};
+
+inline Value
+parse(const std::string &text) {
+    return Parser(text).parse();
+}
+
+}  // namespace json
+}  // namespace swapit
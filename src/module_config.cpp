@@ -0,0 +1,119 @@
+#include "swapit/module_server.h"
+
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "module_config.h"
+
+namespace swapit {
+
+namespace {
+
+PfdlType
+parse_type(const std::string &type) {
+    if(type == "boolean") {
+        return PfdlType::boolean;
+    }
+    if(type == "number") {
+        return PfdlType::number;
+    }
+    if(type == "string") {
+        return PfdlType::string;
+    }
+    throw std::runtime_error("Unknown parameter type \"" + type + "\".");
+}
+
+std::vector<Parameter>
+parse_params(const json::Value &params) {
+    std::vector<Parameter> result;
+    for(const auto &[name, type] : params.object()) {
+        result.push_back({name, parse_type(type.string())});
+    }
+    return result;
+}
+
+ServiceExecution
+parse_execution(const json::Value &config) {
+    const json::Value *v = config.find("execution");
+    if(!v || v->string() == "async") {
+        return ServiceExecution::async;
+    }
+    if(v->string() == "sync") {
+        return ServiceExecution::sync;
+    }
+    throw std::runtime_error("\"execution\" must be \"async\" or \"sync\".");
+}
+
+size_t
+get_size(const json::Value &config, const std::string &key, size_t default_value) {
+    const json::Value *v = config.find(key);
+    if(!v) {
+        return default_value;
+    }
+    double d = v->number();
+    // Casting a double out of the range of size_t is undefined, so the range
+    // is checked first.
+    const double limit = std::ldexp(1.0, std::numeric_limits<size_t>::digits);
+    if(!(d >= 0 && d < limit) || d != std::floor(d)) {
+        throw std::runtime_error("\"" + key + "\" must be a non-negative integer.");
+    }
+    return static_cast<size_t>(d);
+}
+
+}  // namespace
+
+json::Value
+read_config(const std::string &json_file) {
+    std::ifstream ifs(json_file, std::ios::binary);
+    if(!ifs.is_open()) {
+        throw std::runtime_error("Failed to open file: " + json_file + ".");
+    }
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    try {
+        return json::parse(ss.str());
+    } catch(const json::ParseError &e) {
+        throw std::runtime_error(json_file + ": " + e.what());
+    }
+}
+
+ModuleDescription
+read_module_description(const std::string &json_file) {
+    const json::Value config = read_config(json_file);
+
+    ServiceDescription service;
+    service.name = config.at("service_name").string();
+    service.input_params = parse_params(config.at("input_params"));
+    if(service.input_params.empty()) {
+        throw std::runtime_error("Service must provide at least one input parameter.");
+    }
+    std::vector<Parameter> output_params = parse_params(config.at("output_param"));
+    if(output_params.size() != 1) {
+        throw std::runtime_error("Service must provide exactly one output parameter.");
+    }
+    service.output_param = output_params.front();
+    service.max_concurrency = get_size(config, "max_concurrency", 1);
+    service.max_queue_depth = get_size(config, "max_queue_depth", 0);
+    service.max_batch_size = get_size(config, "max_batch_size", 16);
+    service.batch_timeout = get_size(config, "batch_timeout", 0);
+    service.execution = parse_execution(config);
+    if(const json::Value *budget = config.find("sync_budget")) {
+        service.sync_budget = budget->number();
+        if(!(service.sync_budget >= 0 && service.sync_budget <= max_sync_budget)) {
+            std::ostringstream msg;
+            msg << "\"sync_budget\" must be between 0 and " << max_sync_budget << " ms.";
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+    ModuleDescription descr;
+    descr.namespace_name = config.at("namespace").string();
+    descr.type_name = config.at("module_type").string();
+    descr.services.push_back(std::move(service));
+    descr.workers = get_size(config, "workers", 1);
+    return descr;
+}
+
+}  // namespace swapit
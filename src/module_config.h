@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+#include "json.h"
+
+namespace swapit {
+
+// Reads the config file of the server template.
+json::Value
+read_config(const std::string &json_file);
+
+}  // namespace swapit
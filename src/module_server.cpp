@@ -3,20 +3,31 @@
 #include <open62541/server.h>
 #include <open62541/server_config_default.h>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <csignal>
+#include <cstddef>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <optional>
 #include <queue>
 #include <sstream>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
+#include <utility>
 
 #include <nodesets/common_nodeids.h>
 #include <nodesets/namespace_common_generated.h>
@@ -24,14 +35,33 @@
 #include <nodesets/pfdl_nodeids.h>
 #include <nodesets/types_common_generated.h>
 #include <nodesets/types_pfdl_generated.h>
-#include <unordered_map>
 
 extern "C" {
 #include <swap_it.h>
 }
 
+#if UA_OPEN62541_VER_MAJOR > 1 ||                                                    \
+    (UA_OPEN62541_VER_MAJOR == 1 && UA_OPEN62541_VER_MINOR >= 4)
+#define SWAPIT_HAS_EVENTLOOP
+#endif
+
+// Worker threads may only add delayed callbacks to the EventLoop if it is
+// built with locking.
+#if defined(SWAPIT_HAS_EVENTLOOP) && UA_MULTITHREADING >= 100
+#define SWAPIT_HAS_EVENTLOOP_WAKEUP
+#endif
+
 namespace swapit {
 
+// Implemented by the calls of deferred services
+class ServiceCompletion::Impl {
+  public:
+    virtual ~Impl() = default;
+
+    virtual void
+    complete(std::optional<PfdlVariant> result) noexcept = 0;
+};
+
 namespace {
 
 // error
@@ -63,67 +93,711 @@ throw_if_bad(UA_StatusCode status) {
 
 // worker
 
-template <typename T> class Queue {
+// Move-only void() callable stored inline. Unlike std::function, Task never
+// allocates: callables that do not fit into the storage are rejected at
+// compile time.
+class Task {
   public:
-    Queue() = default;
+    static constexpr size_t capacity = 56;
+
+    Task() noexcept = default;
+
+    template <typename F,
+              typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F &&f) noexcept(std::is_nothrow_constructible_v<std::decay_t<F>, F>) {
+        using Fn = std::decay_t<F>;
+        static_assert(sizeof(Fn) <= capacity, "Callable too large for Task.");
+        static_assert(alignof(Fn) <= alignof(std::max_align_t),
+                      "Callable over-aligned for Task.");
+        static_assert(std::is_nothrow_move_constructible_v<Fn>,
+                      "Callable must be nothrow move constructible.");
+        new(&storage_) Fn(std::forward<F>(f));
+        vtable_ = &vtable_for<Fn>;
+    }
+
+    Task(Task &&other) noexcept {
+        take(other);
+    }
+
+    Task &
+    operator=(Task &&other) noexcept {
+        if(this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &
+    operator=(const Task &) = delete;
+
+    ~Task() {
+        reset();
+    }
 
     void
-    enqueue(T f) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        queue_.push(std::move(f));
+    operator()() {
+        vtable_->invoke(&storage_);
+    }
+
+    explicit operator bool() const noexcept {
+        return vtable_ != nullptr;
+    }
+
+  private:
+    struct VTable {
+        void (*invoke)(void *f);
+        void (*move)(void *src, void *dst) noexcept;
+        void (*destroy)(void *f) noexcept;
+    };
+
+    template <typename Fn>
+    static constexpr VTable vtable_for = {
+        [](void *f) { (*static_cast<Fn *>(f))(); },
+        [](void *src, void *dst) noexcept {
+            new(dst) Fn(std::move(*static_cast<Fn *>(src)));
+        },
+        [](void *f) noexcept { static_cast<Fn *>(f)->~Fn(); },
+    };
+
+    void
+    take(Task &other) noexcept {
+        if(other.vtable_) {
+            other.vtable_->move(&other.storage_, &storage_);
+            vtable_ = other.vtable_;
+            other.reset();
+        }
+    }
+
+    void
+    reset() noexcept {
+        if(vtable_) {
+            vtable_->destroy(&storage_);
+            vtable_ = nullptr;
+        }
+    }
+
+  private:
+    alignas(std::max_align_t) unsigned char storage_[capacity];
+    const VTable *vtable_ = nullptr;
+};
+
+constexpr size_t cache_line_size = 64;
+
+// Bounded lock-free multi-producer/multi-consumer ring buffer (D. Vyukov).
+// Each cell carries a sequence number telling producers and consumers whether
+// the cell is free or holds an element for the current lap.
+template <typename T> class RingBuffer {
+  public:
+    explicit RingBuffer(size_t capacity)
+        : mask_(round_up_pow2(capacity) - 1), cells_(new Cell[mask_ + 1]) {
+        for(size_t i = 0; i <= mask_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool
+    try_push(T &&value) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Cell *cell;
+        for(;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if(diff == 0) {
+                if(head_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(diff < 0) {
+                return false;  // full
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value.emplace(std::move(value));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
     }
 
     std::optional<T>
-    dequeue() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if(queue_.empty()) {
+    try_pop() {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Cell *cell;
+        for(;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if(diff == 0) {
+                if(tail_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(diff < 0) {
+                return std::nullopt;  // empty or not yet published
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        std::optional<T> value = std::move(cell->value);
+        cell->value.reset();
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return value;
+    }
+
+    size_t
+    capacity() const noexcept {
+        return mask_ + 1;
+    }
+
+  private:
+    static size_t
+    round_up_pow2(size_t n) {
+        size_t p = 1;
+        while(p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    struct alignas(cache_line_size) Cell {
+        std::atomic<size_t> sequence;
+        std::optional<T> value;
+    };
+
+  private:
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(cache_line_size) std::atomic<size_t> head_ = 0;
+    alignas(cache_line_size) std::atomic<size_t> tail_ = 0;
+};
+
+// Counting semaphore that only takes the mutex if a thread has to sleep.
+class Semaphore {
+  public:
+    void
+    signal(long n = 1) {
+        long prev = count_.fetch_add(n, std::memory_order_release);
+        long to_wake = std::min(-prev, n);
+        if(to_wake > 0) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                wakeups_ += to_wake;
+            }
+            for(long i = 0; i < to_wake; ++i) {
+                cv_.notify_one();
+            }
+        }
+    }
+
+    void
+    wait() {
+        if(count_.fetch_sub(1, std::memory_order_acquire) > 0) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return wakeups_ > 0; });
+        --wakeups_;
+    }
+
+  private:
+    std::atomic<long> count_ = 0;
+    long wakeups_ = 0;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+// Bounded dispatch queue. Producers never block, consumers sleep on a
+// semaphore while the queue is empty.
+template <typename T> class Queue {
+  public:
+    explicit Queue(size_t capacity) : buffer_(capacity) {}
+
+    // Returns false if the queue is full.
+    bool
+    try_enqueue(T f) {
+        if(!buffer_.try_push(std::move(f))) {
+            return false;
+        }
+        items_.signal();
+        return true;
+    }
+
+    // Blocks until an element is available or the queue is closed.
+    std::optional<T>
+    wait_dequeue() {
+        items_.wait();
+        if(closed_.load(std::memory_order_acquire)) {
             return std::nullopt;
         }
-        auto f = std::move(queue_.front());
-        queue_.pop();
+        // The semaphore guarantees an element, but its producer may not have
+        // published it yet.
+        std::optional<T> f;
+        while(!(f = buffer_.try_pop())) {
+            std::this_thread::yield();
+        }
         return f;
     }
 
+    // Wakes the given number of waiting consumers. Pending elements are
+    // discarded.
+    void
+    close(size_t consumers) {
+        closed_.store(true, std::memory_order_release);
+        items_.signal(static_cast<long>(consumers));
+    }
+
   private:
-    std::queue<T> queue_;
-    std::mutex mutex_;
+    RingBuffer<T> buffer_;
+    Semaphore items_;
+    std::atomic<bool> closed_ = false;
+};
+
+constexpr size_t default_queue_capacity = 1024;
+
+class ConcurrencyLimiter;
+
+// Element of the WorkerPool queue. If a limiter is set, the worker runs the
+// tasks deferred by the limiter after the task itself.
+struct Job {
+    Task task;
+    ConcurrencyLimiter *limiter = nullptr;
+};
+
+class WorkerPool {
+  public:
+    explicit WorkerPool(size_t size, size_t capacity = default_queue_capacity)
+        : queue_(capacity) {
+        size = std::max<size_t>(size, 1);
+        threads_.reserve(size);
+        for(size_t i = 0; i < size; ++i) {
+            threads_.emplace_back(&WorkerPool::loop, this);
+        }
+    }
+
+    ~WorkerPool() {
+        queue_.close(threads_.size());
+        for(auto &t : threads_) {
+            if(t.joinable()) {
+                t.join();
+            }
+        }
+    }
+
+    // Returns false if the queue is full.
+    bool
+    try_enqueue(Job job) {
+        return queue_.try_enqueue(std::move(job));
+    }
+
+    size_t
+    size() const noexcept {
+        return threads_.size();
+    }
+
+  private:
+    void
+    loop();
+
+  private:
+    // Keep member order!
+    Queue<Job> queue_;
+    std::vector<std::thread> threads_;
 };
 
-class WorkerThread {
+// Limits the number of tasks running concurrently on a WorkerPool. Tasks
+// exceeding the limit are deferred and run by the worker of a finishing task.
+// A limit of 0 disables the limit.
+class ConcurrencyLimiter {
   public:
-    WorkerThread(std::chrono::milliseconds timeout = std::chrono::milliseconds(100))
-        : timeout_(timeout), is_running_(true), thread_(&WorkerThread::loop, this) {}
+    explicit ConcurrencyLimiter(size_t limit) : limit_(limit) {}
 
-    ~WorkerThread() {
-        is_running_ = false;
-        if(thread_.joinable()) {
-            thread_.join();
+    // Number of tasks that can run at the same time on the given pool.
+    size_t
+    parallelism(const WorkerPool &pool) const noexcept {
+        return limit_ == 0 ? pool.size() : std::min(limit_, pool.size());
+    }
+
+    // Returns false if the task could not be enqueued.
+    bool
+    submit(WorkerPool &pool, Task f) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(limit_ != 0 && running_ >= limit_) {
+                push_pending(std::move(f));
+                return true;
+            }
+            ++running_;
+        }
+        if(!pool.try_enqueue({std::move(f), this})) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --running_;
+            return false;
         }
+        return true;
     }
 
+    // Runs deferred tasks until none is left. Called by the worker after a
+    // submitted task has finished.
     void
-    enqueue(std::function<void()> f) {
-        queue_.enqueue(std::move(f));
+    run_pending() {
+        while(auto next = take_pending()) {
+            (*next)();
+        }
     }
 
   private:
+    // Deferred tasks live in a vector that is compacted instead of freed, so
+    // that deferring does not allocate once the vector has grown.
     void
-    loop() {
-        while(is_running_) {
-            auto f = queue_.dequeue();
-            if(f.has_value()) {
-                std::invoke(*f);
-            } else {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    push_pending(Task f) {
+        if(pending_head_ > 0 && pending_head_ >= pending_.size() / 2) {
+            std::move(pending_.begin() + pending_head_, pending_.end(), pending_.begin());
+            pending_.resize(pending_.size() - pending_head_);
+            pending_head_ = 0;
+        }
+        pending_.push_back(std::move(f));
+    }
+
+    std::optional<Task>
+    take_pending() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(pending_head_ == pending_.size()) {
+            pending_.clear();
+            pending_head_ = 0;
+            --running_;
+            return std::nullopt;
+        }
+        return std::move(pending_[pending_head_++]);
+    }
+
+  private:
+    const size_t limit_;
+    size_t running_ = 0;
+    std::vector<Task> pending_;
+    size_t pending_head_ = 0;
+    std::mutex mutex_;
+};
+
+void
+WorkerPool::loop() {
+    while(auto job = queue_.wait_dequeue()) {
+        job->task();
+        if(job->limiter) {
+            job->limiter->run_pending();
+        }
+    }
+}
+
+// Counts the tasks of a module server that are queued or running. This allows
+// destroying a module server while others keep using the same WorkerPool.
+class TaskTracker {
+  public:
+    // Held by a task from submission until it is destroyed.
+    class Token {
+      public:
+        explicit Token(TaskTracker *tracker) noexcept : tracker_(tracker) {}
+
+        Token(Token &&other) noexcept
+            : tracker_(std::exchange(other.tracker_, nullptr)) {}
+
+        Token &
+        operator=(Token &&) = delete;
+
+        ~Token() {
+            if(tracker_) {
+                tracker_->release();
             }
         }
+
+        bool
+        cancelled() const noexcept {
+            return tracker_->cancelled_.load(std::memory_order_relaxed);
+        }
+
+      private:
+        TaskTracker *tracker_;
+    };
+
+    Token
+    acquire() noexcept {
+        active_.fetch_add(1, std::memory_order_relaxed);
+        return Token(this);
+    }
+
+    // Marks all tasks that did not start yet as cancelled and blocks until
+    // every task is done.
+    void
+    cancel_and_wait() {
+        cancelled_ = true;
+        wait_idle();
+    }
+
+    // Returns true if no task is pending. Everything a task did before it
+    // finished is visible to the caller then.
+    bool
+    idle() const noexcept {
+        return active_.load(std::memory_order_acquire) == 0;
+    }
+
+    // Blocks until every task is done.
+    void
+    wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return active_.load() == 0; });
+    }
+
+  private:
+    void
+    release() noexcept {
+        if(active_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_all();
+        }
+    }
+
+  private:
+    std::atomic<size_t> active_ = 0;
+    std::atomic<bool> cancelled_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+// Wakes a thread waiting for work, e.g. the network loop of a ModuleHost.
+class Signal {
+  public:
+    void
+    notify() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            notified_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    // Returns after notify() was called or the timeout has expired. Returns
+    // whether notify() was called.
+    bool
+    wait_for(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool notified = cv_.wait_for(lock, timeout, [this] { return notified_; });
+        notified_ = false;
+        return notified;
+    }
+
+  private:
+    bool notified_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+// statistics
+
+// Exponentially weighted moving average, safe for concurrent updates.
+class Ewma {
+  public:
+    explicit Ewma(double alpha) : alpha_(alpha) {}
+
+    void
+    add(double x) noexcept {
+        double prev = value_.load(std::memory_order_relaxed);
+        double next;
+        do {
+            next = std::isnan(prev) ? x : prev + alpha_ * (x - prev);
+        } while(!value_.compare_exchange_weak(prev, next, std::memory_order_relaxed));
+    }
+
+    // Returns 0.0 until the first sample was added.
+    double
+    value() const noexcept {
+        double v = value_.load(std::memory_order_relaxed);
+        return std::isnan(v) ? 0.0 : v;
+    }
+
+  private:
+    const double alpha_;
+    std::atomic<double> value_ = std::numeric_limits<double>::quiet_NaN();
+};
+
+// Online estimate of a duration in ms, safe for concurrent updates. The EWMA
+// follows changes within a few samples; capping it at the 90th percentile of
+// the recent samples keeps single outliers from inflating it.
+class DurationEstimator {
+  public:
+    void
+    add(std::chrono::steady_clock::duration d) noexcept {
+        double ms = std::chrono::duration<double, std::milli>(d).count();
+        ewma_.add(ms);
+        size_t i = next_.fetch_add(1, std::memory_order_relaxed);
+        recent_[i % window].store(ms, std::memory_order_relaxed);
+    }
+
+    // Returns 0.0 until the first sample was added.
+    double
+    value() const noexcept {
+        size_t n = std::min(next_.load(std::memory_order_relaxed), window);
+        if(n == 0) {
+            return 0.0;
+        }
+        std::array<double, window> samples;
+        for(size_t i = 0; i < n; ++i) {
+            samples[i] = recent_[i].load(std::memory_order_relaxed);
+        }
+        auto p90 = samples.begin() + (n - 1) * 9 / 10;
+        std::nth_element(samples.begin(), p90, samples.begin() + n);
+        return std::min(ewma_.value(), *p90);
+    }
+
+  private:
+    static constexpr size_t window = 64;
+
+    Ewma ewma_{0.2};
+    std::array<std::atomic<double>, window> recent_{};
+    std::atomic<size_t> next_ = 0;
+};
+
+// Buckets of LatencyHistogram
+namespace histogram {
+
+constexpr unsigned sub_bucket_bits = 4;
+constexpr uint64_t sub_bucket_count = uint64_t(1) << sub_bucket_bits;
+// Values are recorded in us and saturate after about 76 hours.
+constexpr unsigned max_exponent = 37;
+constexpr uint64_t max_value = (uint64_t(2) << max_exponent) - 1;
+
+constexpr unsigned
+floor_log2(uint64_t v) noexcept {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#else
+    unsigned e = 0;
+    while(v >>= 1) {
+        ++e;
+    }
+    return e;
+#endif
+}
+
+constexpr size_t
+bucket(uint64_t v) noexcept {
+    if(v < sub_bucket_count) {
+        return v;
+    }
+    unsigned e = floor_log2(v);
+    return (e - sub_bucket_bits + 1) * sub_bucket_count +
+           ((v >> (e - sub_bucket_bits)) - sub_bucket_count);
+}
+
+// Middle of the values falling into bucket i
+constexpr uint64_t
+midpoint(size_t i) noexcept {
+    if(i < sub_bucket_count) {
+        return i;
+    }
+    unsigned shift = static_cast<unsigned>(i / sub_bucket_count) - 1;
+    uint64_t lower = (sub_bucket_count + i % sub_bucket_count) << shift;
+    return lower + ((uint64_t(1) << shift) >> 1);
+}
+
+static_assert(bucket(sub_bucket_count - 1) + 1 == bucket(sub_bucket_count));
+static_assert(midpoint(bucket(sub_bucket_count)) == sub_bucket_count);
+static_assert(midpoint(bucket(1000)) / 1000.0 > 0.97 &&
+              midpoint(bucket(1000)) / 1000.0 < 1.03);
+
+}  // namespace histogram
+
+// Latency histogram in the style of HdrHistogram. The buckets grow
+// exponentially and are split into linear sub-buckets, which bounds the
+// relative error of the quantiles to 1 / sub_bucket_count. Recording takes a
+// few relaxed atomic operations, so workers never wait for each other.
+class LatencyHistogram {
+  public:
+    void
+    record(std::chrono::steady_clock::duration d) noexcept {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        uint64_t v = std::min(static_cast<uint64_t>(std::max<decltype(us)>(us, 0)),
+                              histogram::max_value);
+        counts_[histogram::bucket(v)].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(v, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while(v > max &&
+              !max_.compare_exchange_weak(max, v, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Samples recorded concurrently may be missing from the summary.
+    LatencySummary
+    summary() const noexcept {
+        std::array<uint64_t, bucket_count> counts;
+        uint64_t total = 0;
+        for(size_t i = 0; i < bucket_count; ++i) {
+            counts[i] = counts_[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+
+        LatencySummary s;
+        s.count = total;
+        if(total == 0) {
+            return s;
+        }
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        auto quantile = [&](double q) {
+            uint64_t rank = std::max<uint64_t>(
+                1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(total))));
+            uint64_t seen = 0;
+            size_t i = 0;
+            while(i + 1 < bucket_count && (seen += counts[i]) < rank) {
+                ++i;
+            }
+            return to_ms(std::min(histogram::midpoint(i), max));
+        };
+        s.mean = to_ms(sum_.load(std::memory_order_relaxed)) / static_cast<double>(total);
+        s.p50 = quantile(0.5);
+        s.p90 = quantile(0.9);
+        s.p99 = quantile(0.99);
+        s.max = to_ms(max);
+        return s;
     }
 
   private:
-    Queue<std::function<void()>> queue_;
-    std::atomic<bool> is_running_;
-    std::chrono::milliseconds timeout_;
-    std::thread thread_;
+    static constexpr size_t bucket_count = histogram::bucket(histogram::max_value) + 1;
+
+    static double
+    to_ms(uint64_t us) noexcept {
+        return static_cast<double>(us) / 1000.0;
+    }
+
+    std::array<std::atomic<uint64_t>, bucket_count> counts_ = {};
+    std::atomic<uint64_t> sum_ = 0;
+    std::atomic<uint64_t> max_ = 0;
+};
+
+// Latency histograms and load of a service. Shared with ModuleServerHandles,
+// so that the statistics remain readable after the server was destroyed.
+struct ServiceStats {
+    std::string name;
+    LatencyHistogram queue_wait;
+    LatencyHistogram run_time;
+    LatencyHistogram event_delay;
+    LatencyHistogram event_emission;
+    // Calls admitted to the queue that did not start yet
+    std::atomic<size_t> queued = 0;
+    // Callbacks running, including deferred callbacks that did not complete
+    std::atomic<size_t> executing = 0;
+    // Method calls received, including rejected ones
+    std::atomic<uint64_t> received = 0;
+
+    ServiceStatistics
+    summary() const {
+        return {name,
+                queue_wait.summary(),
+                run_time.summary(),
+                event_delay.summary(),
+                event_emission.summary(),
+                queued.load(std::memory_order_relaxed),
+                executing.load(std::memory_order_relaxed)};
+    }
 };
 
 // string
@@ -174,6 +848,21 @@ get_type(const PfdlVariant &var) {
     return static_cast<PfdlType>(var.index());
 }
 
+// Output of a method call that has no result
+PfdlVariant
+default_value(PfdlType t) {
+    switch(t) {
+        case PfdlType::boolean:
+            return false;
+        case PfdlType::number:
+            return 0.0;
+        case PfdlType::string:
+            return std::string();
+        default:
+            throw std::logic_error("Unexpected enum class value.");
+    }
+}
+
 // const UA_DataType *
 // get_data_type(PfdlType t) {
 //     switch(t) {
@@ -208,31 +897,49 @@ ua_variant_get(const UA_Variant *v) {
     return *static_cast<T *>(v->data);
 }
 
-template <typename T>
-const T &
-variant_get(const PfdlVariant &v) {
-    try {
-        return std::get<T>(v);
-    } catch(const std::bad_variant_access &e) {
-        throw BadStatusError(UA_STATUSCODE_BADTYPEMISMATCH);
-    }
-}
-
-std::optional<PfdlVariant>
-to_variant(const UA_Variant *v, PfdlType t) {
+// Converts v into a view of its value without copying strings. Returns false
+// if v does not hold a value of type t.
+bool
+to_view(const UA_Variant *v, PfdlType t, PfdlValueView &out) {
     if(!UA_Variant_hasScalarType(v, get_struct_data_type(t))) {
-        return std::nullopt;
+        return false;
     }
     switch(t) {
         case PfdlType::boolean:
-            return ua_variant_get<UA_PfdlBoolean>(v).value;
+            out = static_cast<bool>(ua_variant_get<UA_PfdlBoolean>(v).value);
+            return true;
         case PfdlType::number:
-            return ua_variant_get<UA_PfdlNumber>(v).value;
+            out = static_cast<double>(ua_variant_get<UA_PfdlNumber>(v).value);
+            return true;
         case PfdlType::string: {
-            return to_string(ua_variant_get<UA_PfdlString>(v).value);
+            const UA_String s = ua_variant_get<UA_PfdlString>(v).value;
+            out = std::string_view(reinterpret_cast<const char *>(s.data), s.length);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Copies v into out and reuses the string buffer of out if it already holds a
+// string.
+void
+copy_value(const PfdlValueView &v, PfdlVariant &out) {
+    if(const auto *sv = std::get_if<std::string_view>(&v)) {
+        if(auto *str = std::get_if<std::string>(&out)) {
+            str->assign(sv->data(), sv->size());
+        } else {
+            out.emplace<std::string>(*sv);
         }
+    } else if(const auto *b = std::get_if<bool>(&v)) {
+        out = *b;
+    } else {
+        out = std::get<double>(v);
     }
-    return std::nullopt;
+}
+
+PfdlValueView
+view_of(const PfdlVariant &v) {
+    return std::visit([](const auto &value) { return PfdlValueView(value); }, v);
 }
 
 // namespaces
@@ -421,35 +1128,54 @@ UA_NodeId
 create_event(UA_Server *server, const UA_NodeId &type_id) {
     UA_NodeId event_id;
     throw_if_bad(UA_Server_createEvent(server, type_id, &event_id));
+    return event_id;
+}
 
+void
+write_time(UA_Server *server, const UA_NodeId &event_id) {
+    static const UA_QualifiedName time_name = UA_QUALIFIEDNAME(0, (char *)"Time");
     UA_DateTime time = UA_DateTime_now();
-    throw_if_bad(UA_Server_writeObjectProperty_scalar(server, event_id,
-                                                      ua_qualified_name(0, "Time"), &time,
+    throw_if_bad(UA_Server_writeObjectProperty_scalar(server, event_id, time_name, &time,
                                                       &UA_TYPES[UA_TYPES_DATETIME]));
-    return event_id;
 }
 
+// Browse name of an event property. Resolved once when the event type is
+// created, so that emitting an event needs no lookups.
+struct EventProperty {
+    UA_UInt16 ns;
+    std::string name;
+
+    static EventProperty
+    read(UA_Server *server, const UA_NodeId &property_id) {
+        UA_QualifiedName qn;
+        throw_if_bad(UA_Server_readBrowseName(server, property_id, &qn));
+        EventProperty property{qn.namespaceIndex, to_string(qn.name)};
+        UA_QualifiedName_clear(&qn);
+        return property;
+    }
+
+    UA_QualifiedName
+    qualified_name() const {
+        return ua_qualified_name(ns, name);
+    }
+};
+
 void
 write_exec_result(UA_Server *server, const UA_NodeId &event_id,
-                  const UA_NodeId &exec_result_id, bool success) {
-    UA_QualifiedName name;
-    throw_if_bad(UA_Server_readBrowseName(server, exec_result_id, &name));
-
+                  const EventProperty &exec_result, bool success) {
     UA_ServiceExecutionStatus status =
         success ? UA_SERVICEEXECUTIONSTATUS_SERVICE_EXECUTION_SUCCESS
                 : UA_SERVICEEXECUTIONSTATUS_SERVICE_EXECUTION_FAIL;
 
     return throw_if_bad(UA_Server_writeObjectProperty_scalar(
-        server, event_id, name, &status,
+        server, event_id, exec_result.qualified_name(), &status,
         &UA_TYPES_COMMON[UA_TYPES_COMMON_SERVICEEXECUTIONSTATUS]));
 }
 
 void
-write_result(UA_Server *server, const UA_NodeId &event_id, const UA_NodeId &result_id,
+write_result(UA_Server *server, const UA_NodeId &event_id, const EventProperty &property,
              const PfdlVariant &result) {
-    UA_QualifiedName name;
-    throw_if_bad(UA_Server_readBrowseName(server, result_id, &name));
-
+    const UA_QualifiedName name = property.qualified_name();
     auto write_property = [server, event_id, name](void *data, const UA_DataType *type) {
         throw_if_bad(
             UA_Server_writeObjectProperty_scalar(server, event_id, name, data, type));
@@ -458,23 +1184,28 @@ write_result(UA_Server *server, const UA_NodeId &event_id, const UA_NodeId &resu
     PfdlType type = get_type(result);
     switch(type) {
         case PfdlType::boolean: {
-            UA_PfdlBoolean b = {variant_get<bool>(result)};
+            UA_PfdlBoolean b = {*std::get_if<bool>(&result)};
             write_property(&b, get_struct_data_type(type));
             break;
         }
         case PfdlType::number: {
-            UA_PfdlNumber n = {variant_get<double>(result)};
+            UA_PfdlNumber n = {*std::get_if<double>(&result)};
             write_property(&n, get_struct_data_type(type));
             break;
         }
         case PfdlType::string: {
-            UA_PfdlString s = {ua_string(variant_get<std::string>(result))};
+            UA_PfdlString s = {ua_string(*std::get_if<std::string>(&result))};
             write_property(&s, get_struct_data_type(type));
             break;
         }
     }
 }
 
+// Emits the ServiceFinishedEvents of a service. Instead of creating an event
+// node per emission, which UA_Server_triggerEvent deletes right away, the
+// event nodes are instantiated once and reused: triggering an event copies
+// its fields and assigns a new EventId. Successful and failed executions use
+// separate nodes, so the result of a success never leaks into a failure.
 class ServiceEvent {
   public:
     static ServiceEvent
@@ -482,24 +1213,31 @@ class ServiceEvent {
            const Parameter &output_param) {
         ServiceEvent event;
         event.type_id_ = create_service_event_type(server, ns, name);
-        event.exec_result_id_ = UA_NODEID_NUMERIC(
+        const UA_NodeId exec_result_id = UA_NODEID_NUMERIC(
             ns.common, UA_COMMONID_SERVICEFINISHEDEVENTTYPE_SERVICEEXECUTIONRESULT);
-        event.result_id_ =
-            create_service_event_result(server, ns.module, output_param, event.type_id_);
+        event.exec_result_ = EventProperty::read(server, exec_result_id);
+        event.result_ = EventProperty::read(
+            server,
+            create_service_event_result(server, ns.module, output_param, event.type_id_));
+
+        event.success_id_ = create_event(server, event.type_id_);
+        write_exec_result(server, event.success_id_, event.exec_result_, true);
+        event.failure_id_ = create_event(server, event.type_id_);
+        write_exec_result(server, event.failure_id_, event.exec_result_, false);
         return event;
     }
 
     void
     emit(UA_Server *server, const std::optional<PfdlVariant> &result) const noexcept {
-        const std::string fail_msg = "Failed to emit ServiceFinishedEvent!";
+        const char *fail_msg = "Failed to emit ServiceFinishedEvent!";
         try {
-            const UA_NodeId event_id = create_event(server, type_id_);
-            write_exec_result(server, event_id, exec_result_id_, result.has_value());
+            const UA_NodeId &event_id = result.has_value() ? success_id_ : failure_id_;
+            write_time(server, event_id);
             if(result.has_value()) {
-                write_result(server, event_id, result_id_, *result);
+                write_result(server, event_id, result_, *result);
             }
             throw_if_bad(UA_Server_triggerEvent(
-                server, event_id, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER), NULL, true));
+                server, event_id, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER), NULL, false));
         } catch(const BadStatusError &e) {
             std::cerr << fail_msg << " Failed with Status: " << e.what() << std::endl;
         } catch(...) {
@@ -509,40 +1247,233 @@ class ServiceEvent {
 
   private:
     UA_NodeId type_id_;
-    UA_NodeId exec_result_id_;
-    UA_NodeId result_id_;
+    EventProperty exec_result_;
+    EventProperty result_;
+    UA_NodeId success_id_;
+    UA_NodeId failure_id_;
 };
 
-// service
+struct Completion {
+    const ServiceEvent *event;
+    ServiceStats *stats;
+    std::optional<PfdlVariant> result;
+    // When the call finished
+    std::chrono::steady_clock::time_point finished;
+};
+
+// Collects finished service executions from the workers. The thread running
+// the UA_Server drains the queue and emits the events, so that the server is
+// never accessed from a worker.
+//
+// If a Signal is given, pushing a completion notifies it. Otherwise, with the
+// EventLoop of open62541 v1.4+ built with UA_MULTITHREADING >= 100, the first
+// completion after a drain adds a delayed callback, which interrupts the
+// EventLoop and drains the queue right away. Other builds need the Signal to
+// wake their server loop, since their network layer cannot be interrupted
+// from a worker; see run_server_loop.
+class CompletionQueue {
+  public:
+    explicit CompletionQueue(UA_Server *server, Signal *signal = nullptr)
+        : server_(server), signal_(signal) {
+#ifdef SWAPIT_HAS_EVENTLOOP_WAKEUP
+        wakeup_.callback = [](void *application, void *context) {
+            static_cast<CompletionQueue *>(context)->on_wakeup();
+        };
+        wakeup_.context = this;
+#endif
+    }
+
+    ~CompletionQueue() {
+#ifdef SWAPIT_HAS_EVENTLOOP_WAKEUP
+        if(wakeup_pending_) {
+            UA_EventLoop *el = UA_Server_getConfig(server_)->eventLoop;
+            el->removeDelayedCallback(el, &wakeup_);
+        }
+#endif
+    }
 
-std::vector<Argument>
-convert_arguments(const std::vector<UA_Variant> &input,
-                  const std::vector<Parameter> &params) {
-    if(input.size() != params.size()) {
-        throw BadStatusError(UA_STATUSCODE_BADINVALIDARGUMENT);
+    CompletionQueue(const CompletionQueue &) = delete;
+    CompletionQueue &
+    operator=(const CompletionQueue &) = delete;
+
+    void
+    push(Completion c) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(std::move(c));
+        }
+        wake();
+    }
+
+    // Must only be called from the server thread.
+    void
+    drain() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::swap(pending_, draining_);
+        }
+        for(const auto &c : draining_) {
+            auto start = std::chrono::steady_clock::now();
+            c.stats->event_delay.record(start - c.finished);
+            c.event->emit(server_, c.result);
+            c.stats->event_emission.record(std::chrono::steady_clock::now() - start);
+        }
+        draining_.clear();
+    }
+
+  private:
+    void
+    wake() noexcept {
+        if(signal_) {
+            signal_->notify();
+            return;
+        }
+#ifdef SWAPIT_HAS_EVENTLOOP_WAKEUP
+        if(wakeup_pending_.exchange(true)) {
+            return;  // a drain is already scheduled
+        }
+        UA_EventLoop *el = UA_Server_getConfig(server_)->eventLoop;
+        if(!el) {
+            wakeup_pending_ = false;
+            return;
+        }
+        el->addDelayedCallback(el, &wakeup_);
+#endif
+    }
+
+#ifdef SWAPIT_HAS_EVENTLOOP_WAKEUP
+    void
+    on_wakeup() {
+        // Reset before draining so that a completion pushed during the drain
+        // schedules another wakeup.
+        wakeup_pending_ = false;
+        drain();
     }
+#endif
 
-    std::vector<Argument> args(params.size());
+  private:
+    UA_Server *server_;
+    Signal *signal_;
+    std::vector<Completion> pending_;
+    std::vector<Completion> draining_;
+    std::mutex mutex_;
+#ifdef SWAPIT_HAS_EVENTLOOP_WAKEUP
+    UA_DelayedCallback wakeup_ = {};
+    std::atomic<bool> wakeup_pending_ = false;
+#endif
+};
+
+// service
+
+// Converts input into views of the request. Only valid as long as input.
+// Invalid arguments are reported by status instead of an exception, since
+// clients can send them at any rate.
+UA_StatusCode
+convert_arguments(const UA_Variant *input, size_t input_size,
+                  const std::vector<Parameter> &params,
+                  std::vector<PfdlValueView> &values) {
+    if(input_size != params.size()) {
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    }
+
+    values.resize(params.size());
     for(size_t i = 0; i < params.size(); ++i) {
-        std::optional<PfdlVariant> var = to_variant(&input[i], params[i].type);
-        if(!var.has_value()) {
-            throw BadStatusError(UA_STATUSCODE_BADINVALIDARGUMENT);
+        if(!to_view(&input[i], params[i].type, values[i])) {
+            return UA_STATUSCODE_BADINVALIDARGUMENT;
+        }
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+// Arguments of an accepted call, which outlive the request.
+class CallArguments {
+  public:
+    // Copies values and points the views at the copies and the names of params.
+    void
+    assign(const std::vector<Parameter> &params,
+           const std::vector<PfdlValueView> &values) {
+        values_.resize(values.size());
+        views_.resize(values.size());
+        for(size_t i = 0; i < values.size(); ++i) {
+            copy_value(values[i], values_[i]);
+            views_[i] = {params[i].name, view_of(values_[i])};
+        }
+    }
+
+    const std::vector<ArgumentView> &
+    views() const noexcept {
+        return views_;
+    }
+
+  private:
+    std::vector<PfdlVariant> values_;
+    std::vector<ArgumentView> views_;
+};
+
+// Recycles call arguments between calls. Recycled arguments keep their
+// capacity and that of their strings, so copying the arguments of a call
+// does not allocate once the pool is warm.
+class ArgumentPool {
+    using Arguments = CallArguments;
+
+    struct Release {
+        ArgumentPool *pool;
+
+        void
+        operator()(Arguments *args) const noexcept {
+            pool->release(args);
+        }
+    };
+
+  public:
+    using Handle = std::unique_ptr<Arguments, Release>;
+
+    explicit ArgumentPool(size_t capacity) : free_(capacity) {}
+
+    ~ArgumentPool() {
+        while(auto args = free_.try_pop()) {
+            delete *args;
         }
-        args[i] = {params[i].name, *var};
     }
-    return args;
+
+    Handle
+    acquire() {
+        auto args = free_.try_pop();
+        return Handle(args ? *args : new Arguments(), Release{this});
+    }
+
+  private:
+    void
+    release(Arguments *args) noexcept {
+        if(!free_.try_push(std::move(args))) {
+            delete args;
+        }
+    }
+
+  private:
+    RingBuffer<Arguments *> free_;
+};
+
+// The common model only knows ACCEPTED and INVALID_PARAMETER. Calls that are
+// rejected for other reasons, e.g. BadResourceUnavailable if the service is
+// busy, are not accepted either and are told apart by serviceResultCode.
+UA_ServiceTriggerResult
+get_trigger_result(UA_StatusCode status) {
+    return UA_StatusCode_isBad(status)
+               ? UA_SERVICETRIGGERRESULT_SERVICE_RESULT_INVALID_PARAMETER
+               : UA_SERVICETRIGGERRESULT_SERVICE_RESULT_ACCEPTED;
 }
 
 UA_Variant
-create_sync_result(const std::string &msg, UA_StatusCode status) {
+create_sync_result(std::string_view msg, UA_StatusCode status,
+                   double expected_duration = 0.0) {
     UA_ServiceExecutionAsyncResultDataType result = {};
-    result.serviceResultMessage = ua_string(msg);
+    // Copied by UA_Variant_setScalarCopy, so it need not be null-terminated.
+    result.serviceResultMessage = {
+        msg.size(), reinterpret_cast<UA_Byte *>(const_cast<char *>(msg.data()))};
     result.serviceResultCode = status;
-    result.expectedServiceExecutionDuration = 0.0;
-    result.serviceTriggerResult =
-        status == UA_STATUSCODE_BADINVALIDARGUMENT
-            ? UA_SERVICETRIGGERRESULT_SERVICE_RESULT_INVALID_PARAMETER
-            : UA_SERVICETRIGGERRESULT_SERVICE_RESULT_ACCEPTED;
+    result.expectedServiceExecutionDuration = expected_duration;
+    result.serviceTriggerResult = get_trigger_result(status);
 
     UA_Variant v = {};
     throw_if_bad(UA_Variant_setScalarCopy(
@@ -551,135 +1482,838 @@ create_sync_result(const std::string &msg, UA_StatusCode status) {
     return v;
 }
 
+UA_Variant
+create_sync_execution_result(const std::string &msg, UA_StatusCode status,
+                             bool success) {
+    UA_ServiceExecutionSyncResultDataType result = {};
+    result.serviceResultMessage = ua_string(msg);
+    result.serviceResultCode = status;
+    result.serviceExecutionStatus =
+        success ? UA_SERVICEEXECUTIONSTATUS_SERVICE_EXECUTION_SUCCESS
+                : UA_SERVICEEXECUTIONSTATUS_SERVICE_EXECUTION_FAIL;
+
+    UA_Variant v = {};
+    throw_if_bad(UA_Variant_setScalarCopy(
+        &v, &result,
+        &UA_TYPES_COMMON[UA_TYPES_COMMON_SERVICEEXECUTIONSYNCRESULTDATATYPE]));
+    return v;
+}
+
+UA_Variant
+to_ua_variant(const PfdlVariant &value) {
+    UA_Variant v = {};
+    PfdlType type = get_type(value);
+    switch(type) {
+        case PfdlType::boolean: {
+            UA_PfdlBoolean b = {*std::get_if<bool>(&value)};
+            throw_if_bad(UA_Variant_setScalarCopy(&v, &b, get_struct_data_type(type)));
+            break;
+        }
+        case PfdlType::number: {
+            UA_PfdlNumber n = {*std::get_if<double>(&value)};
+            throw_if_bad(UA_Variant_setScalarCopy(&v, &n, get_struct_data_type(type)));
+            break;
+        }
+        case PfdlType::string: {
+            UA_PfdlString s = {ua_string(*std::get_if<std::string>(&value))};
+            throw_if_bad(UA_Variant_setScalarCopy(&v, &s, get_struct_data_type(type)));
+            break;
+        }
+    }
+    return v;
+}
+
+UA_Argument
+create_argument(const std::string &name, const UA_DataType *type) {
+    UA_Argument arg = {};
+    arg.name = ua_string(name);
+    arg.dataType = type->typeId;
+    arg.valueRank = UA_VALUERANK_SCALAR;
+    return arg;
+}
+
+// The service is attached as node context, so that calls reach it without a
+// lookup. Async services return a ServiceExecutionAsyncResultDataType, sync
+// services a ServiceExecutionSyncResultDataType and the service result.
 UA_NodeId
-create_service_method(UA_Server *server, UA_UInt16 module_ns, const std::string &name,
-                      const std::vector<Parameter> &params, const UA_NodeId &parent_id) {
+create_service_method(UA_Server *server, UA_UInt16 module_ns,
+                      const ServiceDescription &descr, const UA_NodeId &parent_id,
+                      void *service) {
     UA_MethodAttributes attr = UA_MethodAttributes_default;
     std::vector<UA_Argument> input_args;
-    input_args.reserve(params.size());
-    for(const auto &[n, t] : params) {
-        UA_Argument arg = {};
-        arg.name = ua_string(n);
-        arg.dataType = get_struct_data_type(t)->typeId;
-        arg.valueRank = UA_VALUERANK_SCALAR;
-        input_args.push_back(arg);
+    input_args.reserve(descr.input_params.size());
+    for(const auto &[n, t] : descr.input_params) {
+        input_args.push_back(create_argument(n, get_struct_data_type(t)));
     }
 
-    UA_Argument output_arg = {};
-    output_arg.name = ua_string("res");
-    output_arg.dataType =
-        UA_TYPES_COMMON[UA_TYPES_COMMON_SERVICEEXECUTIONASYNCRESULTDATATYPE].typeId,
-    output_arg.valueRank = UA_VALUERANK_SCALAR;
+    std::vector<UA_Argument> output_args;
+    if(descr.execution == ServiceExecution::sync) {
+        output_args.push_back(create_argument(
+            "res",
+            &UA_TYPES_COMMON[UA_TYPES_COMMON_SERVICEEXECUTIONSYNCRESULTDATATYPE]));
+        output_args.push_back(create_argument(
+            descr.output_param.name, get_struct_data_type(descr.output_param.type)));
+    } else {
+        output_args.push_back(create_argument(
+            "res",
+            &UA_TYPES_COMMON[UA_TYPES_COMMON_SERVICEEXECUTIONASYNCRESULTDATATYPE]));
+    }
 
     UA_NodeId method_id;
-    throw_if_bad(UA_Server_addMethodNode(server, default_node_id(module_ns), parent_id,
-                                         UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
-                                         ua_qualified_name(module_ns, name), attr, NULL,
-                                         input_args.size(), input_args.data(), 1,
-                                         &output_arg, NULL, &method_id));
+    throw_if_bad(UA_Server_addMethodNode(
+        server, default_node_id(module_ns), parent_id,
+        UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+        ua_qualified_name(module_ns, descr.name), attr, NULL, input_args.size(),
+        input_args.data(), output_args.size(), output_args.data(), service, &method_id));
     make_mandatory(server, method_id);
     return method_id;
 }
 
+// Execution resources of the services of a module server.
+struct ServiceContext {
+    WorkerPool &workers;
+    CompletionQueue &completions;
+    TaskTracker &tasks;
+};
+
+// Hands the result of a sync call from the worker to the waiting caller. If
+// the caller gave up before, the result is emitted as event instead.
+class SyncCall {
+  public:
+    // Returns false if the caller gave up; result is left untouched then.
+    bool
+    complete(std::optional<PfdlVariant> &result) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(abandoned_) {
+            return false;
+        }
+        result_ = std::move(result);
+        done_ = true;
+        cv_.notify_one();
+        return true;
+    }
+
+    // Returns false and abandons the call if no result arrives within timeout.
+    template <typename Rep, typename Period>
+    bool
+    wait_for(const std::chrono::duration<Rep, Period> &timeout,
+             std::optional<PfdlVariant> &result) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(!cv_.wait_for(lock, timeout, [this] { return done_; })) {
+            abandoned_ = true;
+            return false;
+        }
+        result = std::move(result_);
+        return true;
+    }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::optional<PfdlVariant> result_;
+    bool done_ = false;
+    bool abandoned_ = false;
+};
+
+class AsyncService;
+
+// Stream for the result message of a method call. Unlike a std::stringstream,
+// it keeps its buffer when reset and its contents are read without a copy, so
+// that writing a message does not allocate once the buffer has grown.
+class MessageStream : public std::ostream {
+  public:
+    MessageStream() : std::ostream(&buffer_) {}
+
+    void
+    reset() {
+        clear();
+        buffer_.reset();
+    }
+
+    // Valid until the next write or reset
+    std::string_view
+    view() const {
+        return buffer_.view();
+    }
+
+  private:
+    struct Buffer : std::stringbuf {
+        void
+        reset() {
+            setp(pbase(), epptr());
+        }
+
+        std::string_view
+        view() const {
+            return {pbase(), static_cast<size_t>(pptr() - pbase())};
+        }
+    };
+
+    Buffer buffer_;
+};
+
+// Call of a deferred service between start and completion. Holds the task
+// token, so that the module server waits for the call before it shuts down.
+class DeferredCall final : public ServiceCompletion::Impl {
+  public:
+    DeferredCall(AsyncService &service, TaskTracker::Token token,
+                 std::shared_ptr<SyncCall> sync) noexcept
+        : service_(service), token_(std::move(token)), sync_(std::move(sync)),
+          start_(std::chrono::steady_clock::now()) {}
+
+    // Fails the call if it was not completed.
+    ~DeferredCall() override {
+        complete(std::nullopt);
+    }
+
+    void
+    complete(std::optional<PfdlVariant> result) noexcept override;
+
+  private:
+    AsyncService &service_;
+    // Released on completion, see complete()
+    std::optional<TaskTracker::Token> token_;
+    std::shared_ptr<SyncCall> sync_;
+    std::chrono::steady_clock::time_point start_;
+    std::atomic<bool> done_ = false;
+};
+
+// Accepted call of a batch service waiting to be collected into a batch
+struct BatchItem {
+    ArgumentPool::Handle args;
+    std::chrono::steady_clock::time_point accepted;
+    std::shared_ptr<SyncCall> sync;
+};
+
 class AsyncService {
   public:
-    static AsyncService
-    create(UA_Server *server, const Namespaces &ns, const ServiceDescription &descr) {
-        AsyncService service;
-        service.params_ = descr.input_params;
-        service.callback_ = descr.callback;
-        service.event_ = ServiceEvent::create(server, ns, descr.name, descr.output_param);
+    static std::unique_ptr<AsyncService>
+    create(UA_Server *server, const Namespaces &ns, const ServiceDescription &descr,
+           ServiceContext &context) {
+        auto service = std::make_unique<AsyncService>(context, descr.max_concurrency,
+                                                      descr.max_queue_depth);
+        service->params_ = descr.input_params;
+        service->output_type_ = descr.output_param.type;
+        service->callback_ = descr.callback;
+        service->deferred_callback_ = descr.deferred_callback;
+        service->batch_callback_ = descr.batch_callback;
+        service->max_batch_size_ = descr.max_batch_size;
+        service->batch_timeout_ = std::chrono::microseconds(descr.batch_timeout);
+        service->execution_ = descr.execution;
+        service->sync_budget_ = std::chrono::duration<double, std::milli>(
+            std::clamp(descr.sync_budget, 0.0, max_sync_budget));
+        service->stats_->name = descr.name;
+        service->event_ =
+            ServiceEvent::create(server, ns, descr.name, descr.output_param);
         return service;
     }
 
-    UA_Variant
-    operator()(UA_Server *server, WorkerThread &worker,
-               const std::vector<UA_Variant> &input) const {
-        UA_StatusCode status = UA_STATUSCODE_GOOD;
-        std::stringstream msg;
-        try {
-            std::vector<Argument> args = convert_arguments(input, params_);
-            worker.enqueue(
-                [this, server, args = std::move(args)] { async_callback(server, args); });
+    AsyncService(ServiceContext &context, size_t max_concurrency, size_t max_queue_depth)
+        : context_(context), max_queue_depth_(max_queue_depth),
+          limiter_(max_concurrency) {}
+
+    // Writes the outputs of the service method.
+    void
+    operator()(const UA_Variant *input, size_t input_size, UA_Variant *output) {
+        stats_->received.fetch_add(1, std::memory_order_relaxed);
+        if(execution_ == ServiceExecution::sync) {
+            call_sync(input, input_size, output);
+            return;
+        }
+        MessageStream &msg = message_;
+        msg.reset();
+        double expected_duration = 0.0;
+        UA_StatusCode status = submit(input, input_size, msg, expected_duration);
+        if(UA_StatusCode_isBad(status)) {
+            msg << "Execution failed with Status: " << UA_StatusCode_name(status) << ".";
+        } else {
             msg << "Executing async Service.";
-        } catch(const BadStatusError &e) {
-            status = e.status();
-            msg << "Execution failed with Status: " << e.what() << ".";
         }
-        return create_sync_result(msg.str(), status);
+        output[0] = create_sync_result(msg.view(), status, expected_duration);
+    }
+
+    // Validates the call and queues it for execution. Rejections are returned
+    // as status, so that invalid calls and a full queue do not cost an
+    // exception each. The result of the call is handed to sync if it is
+    // given and waits for it, otherwise it is emitted as event.
+    UA_StatusCode
+    submit(const UA_Variant *input, size_t input_size, std::ostream &msg,
+           double &expected_duration, std::shared_ptr<SyncCall> sync = nullptr) {
+        ServiceContext &ctx = context_;
+        // Validate on views of the request and copy only accepted calls.
+        UA_StatusCode status = convert_arguments(input, input_size, params_, request_);
+        if(UA_StatusCode_isBad(status)) {
+            return status;
+        }
+
+        size_t depth;
+        bool admitted = admit(depth);
+        double wait = estimate_wait(depth, ctx.workers);
+        expected_duration = wait + run_time_.value();
+        msg << "Queue depth: " << depth << ", estimated wait: " << wait << " ms. ";
+        if(!admitted) {
+            return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+        }
+
+        ArgumentPool::Handle args = arguments_.acquire();
+        args->assign(params_, request_);
+        if(batch_callback_) {
+            return push_batch_item(
+                {std::move(args), std::chrono::steady_clock::now(), std::move(sync)});
+        }
+
+        auto task = [this, args = std::move(args), token = ctx.tasks.acquire(),
+                     accepted = std::chrono::steady_clock::now(),
+                     sync = std::move(sync)]() mutable {
+            stats_->queued.fetch_sub(1, std::memory_order_relaxed);
+            if(token.cancelled()) {
+                return;
+            }
+            auto queue_wait = std::chrono::steady_clock::now() - accepted;
+            queue_wait_.add(queue_wait);
+            stats_->queue_wait.record(queue_wait);
+            if(deferred_callback_) {
+                start_deferred(*args, std::move(token), std::move(sync));
+            } else {
+                finish(execute(*args), sync);
+            }
+        };
+        if(!limiter_.submit(ctx.workers, std::move(task))) {
+            stats_->queued.fetch_sub(1, std::memory_order_relaxed);
+            return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+        }
+        return UA_STATUSCODE_GOOD;
+    }
+
+    const std::shared_ptr<ServiceStats> &
+    stats() const noexcept {
+        return stats_;
+    }
+
+    // Called once per call of the deferred callback, from any thread.
+    void
+    finish_deferred(std::optional<PfdlVariant> result,
+                    std::chrono::steady_clock::time_point start,
+                    const std::shared_ptr<SyncCall> &sync) noexcept {
+        auto run_time = std::chrono::steady_clock::now() - start;
+        run_time_.add(run_time);
+        stats_->run_time.record(run_time);
+        stats_->executing.fetch_sub(1, std::memory_order_relaxed);
+        try {
+            finish(std::move(result), sync);
+        } catch(...) {
+            std::cerr << "Failed to queue the result of a Service execution."
+                      << std::endl;
+        }
     }
 
   private:
+    // Runs the call on a worker like an async call, but blocks the server
+    // thread for up to sync_budget_ to return the result with the method
+    // response. A call that takes longer completes asynchronously: it is
+    // answered with GoodCompletesAsynchronously and its result follows as
+    // ServiceFinishedEvent.
     void
-    async_callback(UA_Server *server, std::vector<Argument> args) const noexcept {
+    call_sync(const UA_Variant *input, size_t input_size, UA_Variant *output) {
+        std::stringstream msg;
+        double expected_duration = 0.0;
+        // Allocated per call. It is shared with the worker, which may finish
+        // after the budget expired. Not pooled, since a sync call blocks the
+        // server thread for up to its budget anyway.
+        auto call = std::make_shared<SyncCall>();
+        UA_StatusCode status = submit(input, input_size, msg, expected_duration, call);
         std::optional<PfdlVariant> result;
+        if(UA_StatusCode_isBad(status)) {
+            msg << "Execution failed with Status: " << UA_StatusCode_name(status) << ".";
+        } else if(!call->wait_for(sync_budget_, result)) {
+            status = UA_STATUSCODE_GOODCOMPLETESASYNCHRONOUSLY;
+            msg << "Execution exceeded its time budget, the result follows as "
+                   "ServiceFinishedEvent.";
+        } else if(result.has_value() && get_type(*result) != output_type_) {
+            result.reset();
+            status = UA_STATUSCODE_BADTYPEMISMATCH;
+            msg << "Service returned a result of the wrong type.";
+        } else {
+            msg << "Service finished with "
+                << (result.has_value() ? "SUCCESS" : "ERROR") << ".";
+        }
+
+        // The output argument has the declared type even without a result.
+        UA_Variant value =
+            to_ua_variant(result.has_value() ? *result : default_value(output_type_));
+        // serviceExecutionStatus can only be SUCCESS or FAIL, so a call still
+        // running is reported as FAIL with GoodCompletesAsynchronously.
+        output[0] = create_sync_execution_result(msg.str(), status, result.has_value());
+        output[1] = value;
+    }
+
+    // Queues a call of a batch service. Queued calls are collected by a
+    // runner task, of which at most one is pending at a time: the first call
+    // queued while none is pending schedules one.
+    UA_StatusCode
+    push_batch_item(BatchItem item) {
+        bool schedule;
+        {
+            std::lock_guard<std::mutex> lock(batch_mutex_);
+            batch_.push_back(std::move(item));
+            schedule = !std::exchange(runner_pending_, true);
+        }
+        batch_cv_.notify_one();
+        if(schedule && !schedule_runner()) {
+            // No runner is pending, so the call is still the last one queued.
+            std::lock_guard<std::mutex> lock(batch_mutex_);
+            batch_.pop_back();
+            runner_pending_ = false;
+            stats_->queued.fetch_sub(1, std::memory_order_relaxed);
+            return UA_STATUSCODE_BADRESOURCEUNAVAILABLE;
+        }
+        return UA_STATUSCODE_GOOD;
+    }
+
+    bool
+    schedule_runner() {
+        return limiter_.submit(context_.workers,
+                               [this, token = context_.tasks.acquire()] {
+                                   if(!token.cancelled()) {
+                                       run_batches();
+                                   }
+                               });
+    }
+
+    // Waits until max_batch_size_ calls are queued or batch_timeout_ passed
+    // since the first of them was accepted, and runs the queued calls in
+    // batches. If more calls are left, the next runner is scheduled; it runs
+    // concurrently up to the concurrency limit of the service. The runner
+    // continues itself if the worker queue is full.
+    //
+    // Unlike the other paths, batches allocate: the items and the views of a
+    // batch are collected in vectors per batch, and the queue of calls grows
+    // and shrinks in blocks.
+    void
+    run_batches() {
+        bool more = true;
+        while(more) {
+            std::vector<BatchItem> items;
+            {
+                std::unique_lock<std::mutex> lock(batch_mutex_);
+                if(batch_.empty()) {
+                    runner_pending_ = false;
+                    return;
+                }
+                batch_cv_.wait_until(lock, batch_.front().accepted + batch_timeout_,
+                                     [this] {
+                                         return max_batch_size_ != 0 &&
+                                                batch_.size() >= max_batch_size_;
+                                     });
+                size_t n = max_batch_size_ == 0
+                               ? batch_.size()
+                               : std::min(batch_.size(), max_batch_size_);
+                items.reserve(n);
+                for(size_t i = 0; i < n; ++i) {
+                    items.push_back(std::move(batch_.front()));
+                    batch_.pop_front();
+                }
+                runner_pending_ = !batch_.empty();
+                more = runner_pending_;
+            }
+            stats_->queued.fetch_sub(items.size(), std::memory_order_relaxed);
+            if(more && schedule_runner()) {
+                more = false;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            for(const auto &item : items) {
+                queue_wait_.add(now - item.accepted);
+                stats_->queue_wait.record(now - item.accepted);
+            }
+            execute_batch(items);
+        }
+    }
+
+    // Reserves a slot in the queue of the service. Returns false if the
+    // maximum queue depth is reached; depth receives the depth before the call.
+    bool
+    admit(size_t &depth) noexcept {
+        depth = stats_->queued.load(std::memory_order_relaxed);
+        do {
+            if(max_queue_depth_ != 0 && depth >= max_queue_depth_) {
+                return false;
+            }
+        } while(!stats_->queued.compare_exchange_weak(depth, depth + 1,
+                                                      std::memory_order_relaxed));
+        return true;
+    }
+
+    // Estimated time in ms until a call queued behind depth others starts. If
+    // all slots are busy, the call waits for half a run time on average until
+    // one frees up and for depth run times spread over the slots. The measured
+    // queue wait also covers workers busy with other services of the pool.
+    double
+    estimate_wait(size_t depth, const WorkerPool &workers) const noexcept {
+        size_t parallelism = limiter_.parallelism(workers);
+        if(depth + stats_->executing.load(std::memory_order_relaxed) < parallelism) {
+            return 0.0;
+        }
+        double model = (static_cast<double>(depth) + 0.5) * run_time_.value() /
+                       static_cast<double>(parallelism);
+        return std::max(model, queue_wait_.value());
+    }
+
+    std::optional<PfdlVariant>
+    execute(const CallArguments &args) noexcept {
+        std::optional<PfdlVariant> result;
+        stats_->executing.fetch_add(1, std::memory_order_relaxed);
         try {
-            std::cout << "Starting Service execution" << std::endl;
-            result = callback_(args);
-            std::cout << "Service finished with "
-                      << (result.has_value() ? "SUCCESS" : "ERROR") << "." << std::endl;
+            auto start = std::chrono::steady_clock::now();
+            result = callback_(args.views());
+            auto run_time = std::chrono::steady_clock::now() - start;
+            run_time_.add(run_time);
+            stats_->run_time.record(run_time);
         } catch(...) {
             std::cerr << "An unknown exception occured during Service execution."
                       << std::endl;
         }
-        event_.emit(server, result);
+        stats_->executing.fetch_sub(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    // Emits one event per call or hands the result to the waiting caller.
+    void
+    execute_batch(std::vector<BatchItem> &items) noexcept {
+        std::vector<std::optional<PfdlVariant>> results;
+        stats_->executing.fetch_add(1, std::memory_order_relaxed);
+        try {
+            std::vector<std::vector<ArgumentView>> batch;
+            batch.reserve(items.size());
+            for(const auto &item : items) {
+                batch.push_back(item.args->views());
+            }
+            auto start = std::chrono::steady_clock::now();
+            results = batch_callback_(batch);
+            // Record the share of each call, so that the run time and the
+            // estimated wait of the queued calls stay per call.
+            auto run_time = (std::chrono::steady_clock::now() - start) /
+                            static_cast<std::chrono::steady_clock::rep>(items.size());
+            run_time_.add(run_time);
+            for(size_t i = 0; i < items.size(); ++i) {
+                stats_->run_time.record(run_time);
+            }
+            if(results.size() != items.size()) {
+                std::cerr << "Batch callback returned " << results.size()
+                          << " results for " << items.size() << " calls." << std::endl;
+            }
+        } catch(...) {
+            std::cerr << "An unknown exception occured during Service execution."
+                      << std::endl;
+        }
+        stats_->executing.fetch_sub(1, std::memory_order_relaxed);
+
+        for(size_t i = 0; i < items.size(); ++i) {
+            std::optional<PfdlVariant> result;
+            if(i < results.size()) {
+                result = std::move(results[i]);
+            }
+            finish(std::move(result), items[i].sync);
+        }
+    }
+
+    void
+    start_deferred(const CallArguments &args, TaskTracker::Token token,
+                   std::shared_ptr<SyncCall> sync) noexcept {
+        stats_->executing.fetch_add(1, std::memory_order_relaxed);
+        try {
+            // The completion is allocated per call. It is shared with the
+            // callback, which may keep copies beyond the call, e.g. in Python.
+            deferred_callback_(args.views(),
+                               ServiceCompletion(std::make_shared<DeferredCall>(
+                                   *this, std::move(token), std::move(sync))));
+        } catch(...) {
+            // The call fails when the last copy of its completion is gone.
+            std::cerr << "An unknown exception occured during Service execution."
+                      << std::endl;
+        }
+    }
+
+    // Hands the result to the waiting caller of a sync call or emits it.
+    void
+    finish(std::optional<PfdlVariant> result, const std::shared_ptr<SyncCall> &sync) {
+        if(!sync || !sync->complete(result)) {
+            context_.completions.push({&event_, stats_.get(), std::move(result),
+                                       std::chrono::steady_clock::now()});
+        }
     }
 
   private:
+    ServiceContext &context_;
     std::vector<Parameter> params_;
+    PfdlType output_type_ = PfdlType::boolean;
     ServiceCallback callback_;
+    DeferredCallback deferred_callback_;
+    BatchCallback batch_callback_;
+    size_t max_batch_size_ = 0;
+    std::chrono::microseconds batch_timeout_{0};
+    ServiceExecution execution_ = ServiceExecution::async;
+    std::chrono::duration<double, std::milli> sync_budget_{0.0};
+    // Views of the request being validated. Only used by the server thread.
+    std::vector<PfdlValueView> request_;
+    // Message of the method result. Only used by the server thread.
+    MessageStream message_;
     ServiceEvent event_;
+    const size_t max_queue_depth_;
+    DurationEstimator run_time_;
+    DurationEstimator queue_wait_;
+    std::shared_ptr<ServiceStats> stats_ = std::make_shared<ServiceStats>();
+    // Keep member order! Deferred tasks and queued batch calls hold arguments
+    // of the pool.
+    ArgumentPool arguments_{default_queue_capacity};
+    std::mutex batch_mutex_;
+    std::condition_variable batch_cv_;
+    std::deque<BatchItem> batch_;
+    bool runner_pending_ = false;
+    ConcurrencyLimiter limiter_;
 };
 
+void
+DeferredCall::complete(std::optional<PfdlVariant> result) noexcept {
+    if(!done_.exchange(true)) {
+        service_.finish_deferred(std::move(result), start_, sync_);
+        // Nothing uses the call anymore. Copies of the completion may be kept
+        // alive, e.g. by a Python reference cycle, and must not delay the
+        // shutdown of the server waiting for its tasks.
+        sync_.reset();
+        token_.reset();
+    }
+}
+
 struct ServiceDefinition {
     UA_NodeId method_id;
-    AsyncService service;
+    std::unique_ptr<AsyncService> service;
 };
 
 ServiceDefinition
 create_service(UA_Server *server, const Namespaces &ns, const UA_NodeId &parent_id,
-               const ServiceDescription &descr) {
+               const ServiceDescription &descr, ServiceContext &context) {
     ServiceDefinition def;
-    def.method_id = create_service_method(server, ns.module, descr.name,
-                                          descr.input_params, parent_id);
-    def.service = AsyncService::create(server, ns, descr);
+    def.service = AsyncService::create(server, ns, descr, context);
+    def.method_id =
+        create_service_method(server, ns.module, descr, parent_id, def.service.get());
     return def;
 }
 
 // service store
 
+// Owns the services of a module server. Calls are dispatched through the
+// method node context, the store is only searched for methods without one.
 class ServiceStore {
   public:
     ServiceStore() = default;
 
+    ~ServiceStore() {
+        for(auto &s : services_) {
+            UA_NodeId_clear(&s.method_id);
+        }
+    }
+
+    ServiceStore(const ServiceStore &) = delete;
+    ServiceStore &
+    operator=(const ServiceStore &) = delete;
+
     void
     add(ServiceDefinition &&def) {
-        services_[UA_NodeId_hash(&def.method_id)] = def.service;
+        services_.push_back(std::move(def));
+    }
+
+    // Returns nullptr if method_id is not a service.
+    AsyncService *
+    find(const UA_NodeId &method_id) const noexcept {
+        for(const auto &s : services_) {
+            if(UA_NodeId_equal(&s.method_id, &method_id)) {
+                return s.service.get();
+            }
+        }
+        return nullptr;
     }
 
-    const AsyncService &
-    get(const UA_NodeId &method_id) const {
-        auto it = services_.find(UA_NodeId_hash(&method_id));
-        if(it == services_.end()) {
-            throw BadStatusError(UA_STATUSCODE_BADNOENTRYEXISTS);
+    template <typename F>
+    void
+    for_each(F &&f) const {
+        for(const auto &s : services_) {
+            std::invoke(f, *s.service);
         }
-        return it->second;
     }
 
   private:
-    std::unordered_map<UA_UInt32, AsyncService> services_;
+    std::vector<ServiceDefinition> services_;
 };
 
+// statistics nodes
+
+template <typename T>
+const UA_DataType *
+latency_data_type() {
+    return &UA_TYPES[std::is_same_v<T, double> ? UA_TYPES_DOUBLE : UA_TYPES_UINT64];
+}
+
+template <typename T, T LatencySummary::*field>
+UA_StatusCode
+read_latency(UA_Server *server, const UA_NodeId *session_id, void *session_context,
+             const UA_NodeId *node_id, void *node_context, UA_Boolean source_timestamp,
+             const UA_NumericRange *range, UA_DataValue *value) noexcept {
+    const auto *histogram = static_cast<const LatencyHistogram *>(node_context);
+    T v = histogram->summary().*field;
+    UA_StatusCode status =
+        UA_Variant_setScalarCopy(&value->value, &v, latency_data_type<T>());
+    value->hasValue = status == UA_STATUSCODE_GOOD;
+    return status;
+}
+
+template <typename T, T LatencySummary::*field>
+void
+add_latency_variable(UA_Server *server, UA_UInt16 ns, const UA_NodeId &parent_id,
+                     const std::string &name, LatencyHistogram &histogram) {
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.displayName = ua_localized_text(name);
+    attr.dataType = latency_data_type<T>()->typeId;
+    attr.valueRank = UA_VALUERANK_SCALAR;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+
+    UA_DataSource source = {};
+    source.read = read_latency<T, field>;
+    throw_if_bad(UA_Server_addDataSourceVariableNode(
+        server, default_node_id(ns), parent_id,
+        UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT), ua_qualified_name(ns, name),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE), attr, source, &histogram,
+        NULL));
+}
+
+UA_NodeId
+add_object(UA_Server *server, UA_UInt16 ns, const UA_NodeId &parent_id,
+           const std::string &name) {
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+    attr.displayName = ua_localized_text(name);
+
+    UA_NodeId id;
+    throw_if_bad(UA_Server_addObjectNode(server, default_node_id(ns), parent_id,
+                                         UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                         ua_qualified_name(ns, name),
+                                         UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                         attr, NULL, &id));
+    return id;
+}
+
+// Latencies in ms, read from the histogram on each read request
+void
+add_latency_object(UA_Server *server, UA_UInt16 ns, const UA_NodeId &parent_id,
+                   const std::string &name, LatencyHistogram &histogram) {
+    UA_NodeId id = add_object(server, ns, parent_id, name);
+    add_latency_variable<uint64_t, &LatencySummary::count>(server, ns, id, "Count",
+                                                           histogram);
+    add_latency_variable<double, &LatencySummary::mean>(server, ns, id, "Mean",
+                                                        histogram);
+    add_latency_variable<double, &LatencySummary::p50>(server, ns, id, "P50", histogram);
+    add_latency_variable<double, &LatencySummary::p90>(server, ns, id, "P90", histogram);
+    add_latency_variable<double, &LatencySummary::p99>(server, ns, id, "P99", histogram);
+    add_latency_variable<double, &LatencySummary::max>(server, ns, id, "Max", histogram);
+}
+
+// Adds a Statistics object with the latencies of the services to each
+// instance of the module type.
+void
+publish_statistics(UA_Server *server, const UA_NodeId &type_id,
+                   const ServiceStore &services) {
+    UA_BrowseDescription bd;
+    UA_BrowseDescription_init(&bd);
+    bd.nodeId = type_id;
+    bd.browseDirection = UA_BROWSEDIRECTION_INVERSE;
+    bd.referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HASTYPEDEFINITION);
+    bd.nodeClassMask = UA_NODECLASS_OBJECT;
+    bd.resultMask = UA_BROWSERESULTMASK_NONE;
+
+    UA_BrowseResult br = UA_Server_browse(server, 0, &bd);
+    std::unique_ptr<UA_BrowseResult, decltype(&UA_BrowseResult_clear)> guard(
+        &br, &UA_BrowseResult_clear);
+    throw_if_bad(br.statusCode);
+
+    const UA_UInt16 ns = type_id.namespaceIndex;
+    for(size_t i = 0; i < br.referencesSize; ++i) {
+        UA_NodeId stats_id = add_object(server, ns, br.references[i].nodeId.nodeId,
+                                        "Statistics");
+        services.for_each([&](const AsyncService &service) {
+            ServiceStats &stats = *service.stats();
+            UA_NodeId service_id = add_object(server, ns, stats_id, stats.name);
+            add_latency_object(server, ns, service_id, "QueueWait", stats.queue_wait);
+            add_latency_object(server, ns, service_id, "RunTime", stats.run_time);
+            add_latency_object(server, ns, service_id, "EventDelay", stats.event_delay);
+            add_latency_object(server, ns, service_id, "EventEmission",
+                               stats.event_emission);
+        });
+    }
+}
+
 // module server
 
+// Runs its services on the given WorkerPool, which may be shared with other
+// module servers. If a Signal is given, it is notified when a service has
+// finished.
 class ModuleServer {
   public:
-    ModuleServer(const ModuleDescription &descr);
+    ModuleServer(const ModuleDescription &descr, WorkerPool &workers,
+                 Signal *signal = nullptr);
 
-    UA_Variant
-    call_async_service(const UA_NodeId &method_id, const std::vector<UA_Variant> &input) {
-        const AsyncService &service = services_.get(method_id);
-        return service(server_.get(), worker_, input);
+    // Skips queued service calls and waits for running ones.
+    ~ModuleServer() {
+        tasks_.cancel_and_wait();
+    }
+
+    ModuleServer(const ModuleServer &) = delete;
+    ModuleServer &
+    operator=(const ModuleServer &) = delete;
+
+    // Returns nullptr if method_id is not a service of this module.
+    AsyncService *
+    find_service(const UA_NodeId &method_id) const noexcept {
+        return services_.find(method_id);
+    }
+
+    // Emits the events of finished services. Must be called from the thread
+    // running the server.
+    void
+    process_completions() {
+        completions_.drain();
+    }
+
+    // Returns true if no call is queued or running. The completions of all
+    // finished calls are queued then, so none can arrive until the next call.
+    bool
+    idle() const noexcept {
+        return tasks_.idle();
+    }
+
+    // Must be called after the server template created the module instance.
+    void
+    publish_statistics() {
+        swapit::publish_statistics(server(), type_id_, services_);
+    }
+
+    std::vector<std::shared_ptr<ServiceStats>>
+    statistics() const {
+        std::vector<std::shared_ptr<ServiceStats>> stats;
+        services_.for_each([&](const AsyncService &s) { stats.push_back(s.stats()); });
+        return stats;
+    }
+
+    // Returns the number of method calls received by the services. Adds
+    // whether calls are queued or running to busy.
+    uint64_t
+    activity(bool &busy) const noexcept {
+        uint64_t received = 0;
+        services_.for_each([&](const AsyncService &s) {
+            const ServiceStats &stats = *s.stats();
+            received += stats.received.load(std::memory_order_relaxed);
+            busy = busy || stats.queued.load(std::memory_order_relaxed) != 0 ||
+                   stats.executing.load(std::memory_order_relaxed) != 0;
+        });
+        return received;
     }
 
     UA_Server *
@@ -691,7 +2325,10 @@ class ModuleServer {
     // Keep member order!
     std::unique_ptr<UA_Server, decltype(&UA_Server_delete)> server_;
     ServiceStore services_;
-    WorkerThread worker_;
+    UA_NodeId type_id_;
+    CompletionQueue completions_;
+    TaskTracker tasks_;
+    ServiceContext context_;
 };
 
 void
@@ -719,8 +2356,15 @@ service_callback(UA_Server *server, const UA_NodeId *session_id, void *session_h
                  UA_Variant *output) noexcept {
     UA_StatusCode status = UA_STATUSCODE_GOOD;
     try {
-        *output = get_server_context(server).call_async_service(
-            *method_id, std::vector<UA_Variant>(input, input + input_size));
+        auto *service = static_cast<AsyncService *>(method_context);
+        if(!service) {
+            // The method node was copied without its context.
+            service = get_server_context(server).find_service(*method_id);
+            if(!service) {
+                return UA_STATUSCODE_BADNOENTRYEXISTS;
+            }
+        }
+        (*service)(input, input_size, output);
     } catch(const BadStatusError &e) {
         status = e.status();
     } catch(...) {
@@ -729,24 +2373,29 @@ service_callback(UA_Server *server, const UA_NodeId *session_id, void *session_h
     return status;
 }
 
-void
-init_module(UA_Server *server, ServiceStore &services_, const ModuleDescription &descr) {
+// Returns the id of the module type.
+UA_NodeId
+init_module(UA_Server *server, ServiceStore &services_, const ModuleDescription &descr,
+            ServiceContext &context) {
     Namespaces ns = add_namespaces(server, descr.namespace_name);
     make_variables_writable(server, ns.common);
     const UA_NodeId type_id = create_module_type_object(server, ns, descr.type_name);
     const UA_NodeId services_id = create_services_object(server, ns.common, type_id);
     for(const auto &s : descr.services) {
-        services_.add(create_service(server, ns, services_id, s));
+        services_.add(create_service(server, ns, services_id, s, context));
     }
+    return type_id;
 };
 
-ModuleServer::ModuleServer(const ModuleDescription &descr)
-    : server_(UA_Server_new(), &UA_Server_delete) {
+ModuleServer::ModuleServer(const ModuleDescription &descr, WorkerPool &workers,
+                           Signal *signal)
+    : server_(UA_Server_new(), &UA_Server_delete), completions_(server(), signal),
+      context_{workers, completions_, tasks_} {
     if(!server()) {
         throw BadStatusError();
     }
     set_server_context(server(), this);
-    init_module(server(), services_, descr);
+    type_id_ = init_module(server(), services_, descr, context_);
 }
 
 // server template
@@ -761,44 +2410,369 @@ read_binary_file(const std::string &json_file) {
     return std::vector<uint8_t>(std::istreambuf_iterator<char>(ifs), {});
 }
 
-bool is_running = true;
-void
-run_template_server(UA_Server *server, const std::vector<uint8_t> &json_bytes,
-                    bool to_registry) {
+// run control
 
-    auto signal_handler = [](int sig) { is_running = false; };
+// Set by the handler installed by RunControls that handle SIGINT and SIGTERM.
+std::atomic<bool> signal_received = false;
+static_assert(std::atomic<bool>::is_always_lock_free);
+
+void
+install_signal_handler() {
+    signal_received = false;
+    auto signal_handler = [](int sig) { signal_received = true; };
     std::signal(SIGINT, signal_handler);
     std::signal(SIGTERM, signal_handler);
+}
 
-    // UA_ServerConfig_setDefault(UA_Server_getConfig(server));
-    // UA_Server_run(server, &is_running);
+// Stop flag of one server loop. Signal handling is opt-in: only loops whose
+// RunControl handles signals stop on SIGINT and SIGTERM.
+class RunControl {
+  public:
+    explicit RunControl(bool handle_signals) : handle_signals_(handle_signals) {
+        if(handle_signals_) {
+            install_signal_handler();
+        }
+    }
 
-    UA_service_server_interpreter config = {};
-    throw_if_bad(UA_server_swap_it(server, ua_byte_string(json_bytes), service_callback,
-                                   false, &is_running, to_registry, &config));
+    bool
+    running() const noexcept {
+        return !stop_requested_ && !(handle_signals_ && signal_received);
+    }
 
-    while(is_running) {
-        UA_Server_run_iterate(server, true);
+    // May be called from any thread.
+    void
+    stop() noexcept {
+        stop_requested_ = true;
     }
 
-    clear_swap_server(&config, to_registry, server);
-}
+  private:
+    const bool handle_signals_;
+    std::atomic<bool> stop_requested_ = false;
+};
 
-}  // namespace
+// Configures a module server with the server template and clears the template
+// again on destruction.
+class TemplateServer {
+  public:
+    TemplateServer(ModuleServer &module_server, const std::vector<uint8_t> &json_bytes,
+                   bool to_registry)
+        : module_server_(module_server), to_registry_(to_registry) {
+        throw_if_bad(UA_server_swap_it(module_server_.server(),
+                                       ua_byte_string(json_bytes), service_callback,
+                                       false, &running_, to_registry_, &config_));
+        try {
+            module_server_.publish_statistics();
+        } catch(const BadStatusError &e) {
+            std::cerr << "Failed to publish statistics. Status: " << e.what()
+                      << std::endl;
+        }
+    }
+
+    ~TemplateServer() {
+        running_ = false;
+        clear_swap_server(&config_, to_registry_, module_server_.server());
+    }
 
+    TemplateServer(const TemplateServer &) = delete;
+    TemplateServer &
+    operator=(const TemplateServer &) = delete;
+
+    // Runs one iteration of the server loop and emits the events of finished
+    // services. Returns the time in ms until the next timed callback is due.
+    UA_UInt16
+    iterate(bool wait) {
+        UA_UInt16 timeout = UA_Server_run_iterate(module_server_.server(), wait);
+        module_server_.process_completions();
+        return timeout;
+    }
+
+  private:
+    ModuleServer &module_server_;
+    bool to_registry_;
+    // Run flag handed to the template
+    UA_Boolean running_ = true;
+    UA_service_server_interpreter config_ = {};
+};
+
+// Upper bound for the time a server loop waits without polling the network
+// while calls are running. A finished call wakes the loop right away, but new
+// requests are picked up with up to this delay meanwhile.
+constexpr std::chrono::milliseconds busy_poll_interval(1);
+
+// Runs the loop of a single module server until control is stopped.
+//
+// The events of finished calls are emitted right away. While no call is queued
+// or running, no completion can arrive, so the loop waits in the network layer
+// and answers new requests immediately. While calls run, it polls the network
+// every busy_poll_interval and is woken by the completions through signal in
+// between. Without a signal, the completions must interrupt the EventLoop of
+// open62541 v1.4+ themselves, and the loop always waits in the network layer.
 void
-run_module_server(ModuleDescription descr, const std::string &json_file,
-                  bool to_registry) {
+run_server_loop(TemplateServer &template_server, ModuleServer &module_server,
+                Signal *signal, const RunControl &control) {
+    while(control.running()) {
+        if(!signal || module_server.idle()) {
+            // Emits the completions queued since the last iteration.
+            module_server.process_completions();
+            template_server.iterate(true);
+            continue;
+        }
+        auto timeout = std::chrono::milliseconds(template_server.iterate(false));
+        signal->wait_for(std::min(timeout, busy_poll_interval));
+    }
+}
+
+// Runs a module server on the calling thread until control is stopped.
+// on_started is called once the server accepts calls.
+void
+serve(const ModuleDescription &descr, const std::string &json_file, bool to_registry,
+      const RunControl &control,
+      const std::function<void(const ModuleServer &)> &on_started = {}) {
+    auto json_bytes = read_binary_file(json_file);
+    WorkerPool workers(descr.workers);
+#ifdef SWAPIT_HAS_EVENTLOOP_WAKEUP
+    // The completions wake the EventLoop.
+    Signal *signal = nullptr;
+#else
+    Signal completed;
+    Signal *signal = &completed;
+#endif
+    ModuleServer module_server(descr, workers, signal);
+
+    // UA_ServerConfig_setDefault(UA_Server_getConfig(server));
+    // UA_Server_run(server, &is_running);
+
+    TemplateServer template_server(module_server, json_bytes, to_registry);
+    if(on_started) {
+        on_started(module_server);
+    }
+    run_server_loop(template_server, module_server, signal, control);
+}
+
+// Returns false if f threw.
+bool
+report_errors(const std::function<void()> &f) noexcept {
     try {
-        auto json_bytes = read_binary_file(json_file);
-        ModuleServer module_server(descr);
-        run_template_server(module_server.server(), json_bytes, to_registry);
+        std::invoke(f);
+        return true;
     } catch(const BadStatusError &e) {
         std::cerr << "An error occured during execution. Status: " << e.what()
                   << std::endl;
+    } catch(const std::exception &e) {
+        std::cerr << "An error occured during execution: " << e.what() << std::endl;
     } catch(...) {
         std::cerr << "An unknown exception occured during execution." << std::endl;
     }
+    return false;
+}
+
+// module host
+
+// Upper bound for the time the host loop waits without polling the network
+// while its modules are called. The servers of a host share one thread, so no
+// server may block it; new requests are therefore picked up with up to this
+// delay.
+constexpr std::chrono::milliseconds host_poll_interval = busy_poll_interval;
+// While no service is called, the interval doubles up to this bound, which
+// halves the polling of idle hosts. The servers have separate network layers,
+// so the host cannot wait on all of them for a request; the first request
+// after an idle period is picked up with up to this delay.
+constexpr std::chrono::milliseconds host_idle_poll_interval(2);
+
+// Runs the servers of several modules on one thread. A sync service blocks
+// this thread, and with it every hosted module, for up to its sync_budget.
+class ModuleHost {
+  public:
+    ModuleHost(const std::vector<HostedModule> &modules, size_t workers)
+        : workers_(workers) {
+        servers_.reserve(modules.size());
+        for(const auto &m : modules) {
+            auto json_bytes = read_binary_file(m.json_file);
+            auto &server = servers_.emplace_back(
+                std::make_unique<ModuleServer>(m.descr, workers_, &signal_));
+            templates_.push_back(
+                std::make_unique<TemplateServer>(*server, json_bytes, m.to_registry));
+        }
+    }
+
+    void
+    run(const RunControl &control) {
+        auto poll_interval = host_poll_interval;
+        uint64_t received = 0;
+        while(control.running()) {
+            auto timeout = poll_interval;
+            for(auto &t : templates_) {
+                timeout = std::min(timeout, std::chrono::milliseconds(t->iterate(false)));
+            }
+            bool busy = signal_.wait_for(timeout);
+            uint64_t now_received = 0;
+            for(const auto &s : servers_) {
+                now_received += s->activity(busy);
+            }
+            if(busy || now_received != received) {
+                poll_interval = host_poll_interval;
+            } else {
+                poll_interval = std::min(poll_interval * 2, host_idle_poll_interval);
+            }
+            received = now_received;
+        }
+    }
+
+  private:
+    // Keep member order!
+    WorkerPool workers_;
+    Signal signal_;
+    std::vector<std::unique_ptr<ModuleServer>> servers_;
+    std::vector<std::unique_ptr<TemplateServer>> templates_;
+};
+
+}  // namespace
+
+bool
+run_module_server(ModuleDescription descr, const std::string &json_file, bool to_registry,
+                  bool handle_signals) {
+    RunControl control(handle_signals);
+    return report_errors([&] { serve(descr, json_file, to_registry, control); });
+}
+
+bool
+run_module_host(std::vector<HostedModule> modules, size_t workers, bool handle_signals) {
+    RunControl control(handle_signals);
+    return report_errors([&] {
+        ModuleHost host(modules, workers);
+        host.run(control);
+    });
+}
+
+// service completion
+
+ServiceCompletion::ServiceCompletion(std::shared_ptr<Impl> impl)
+    : impl_(std::move(impl)) {}
+
+void
+ServiceCompletion::operator()(std::optional<PfdlVariant> result) const {
+    impl_->complete(std::move(result));
+}
+
+// module server handle
+
+struct ModuleServerHandle::Impl {
+    ModuleDescription descr;
+    std::string json_file;
+    bool to_registry;
+    bool handle_signals;
+    // Replaced by start() while stop() may read it, so guarded by mutex
+    std::unique_ptr<RunControl> control;
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::shared_ptr<ServiceStats>> stats;
+    // Guarded by mutex, except for reads of running
+    std::atomic<bool> running = false;
+    bool finished = false;
+};
+
+ModuleServerHandle::ModuleServerHandle(ModuleDescription descr, std::string json_file,
+                                       bool to_registry, bool handle_signals)
+    : impl_(std::make_unique<Impl>()) {
+    impl_->descr = std::move(descr);
+    impl_->json_file = std::move(json_file);
+    impl_->to_registry = to_registry;
+    impl_->handle_signals = handle_signals;
+}
+
+ModuleServerHandle::~ModuleServerHandle() {
+    if(impl_) {
+        stop();
+        wait();
+    }
+}
+
+ModuleServerHandle::ModuleServerHandle(ModuleServerHandle &&) noexcept = default;
+
+void
+ModuleServerHandle::start() {
+    if(!impl_) {
+        throw std::logic_error("Module server handle was moved from.");
+    }
+    if(impl_->thread.joinable()) {
+        throw std::logic_error("Module server was already started.");
+    }
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        impl_->control = std::make_unique<RunControl>(impl_->handle_signals);
+        impl_->finished = false;
+    }
+    impl_->thread = std::thread([impl = impl_.get()] {
+        report_errors([impl] {
+            serve(impl->descr, impl->json_file, impl->to_registry, *impl->control,
+                  [impl](const ModuleServer &server) {
+                      {
+                          std::lock_guard<std::mutex> lock(impl->mutex);
+                          impl->stats = server.statistics();
+                          impl->running = true;
+                      }
+                      impl->cv.notify_all();
+                  });
+        });
+        {
+            std::lock_guard<std::mutex> lock(impl->mutex);
+            impl->running = false;
+            impl->finished = true;
+        }
+        impl->cv.notify_all();
+    });
+}
+
+void
+ModuleServerHandle::stop() noexcept {
+    if(!impl_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    if(impl_->control) {
+        impl_->control->stop();
+    }
+}
+
+void
+ModuleServerHandle::wait() {
+    if(impl_ && impl_->thread.joinable()) {
+        impl_->thread.join();
+    }
+}
+
+bool
+ModuleServerHandle::running() const noexcept {
+    return impl_ && impl_->running.load();
+}
+
+bool
+ModuleServerHandle::wait_until_running(double timeout) {
+    if(!impl_) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(impl_->mutex);
+    if(!impl_->thread.joinable()) {
+        return false;
+    }
+    impl_->cv.wait_for(lock, std::chrono::duration<double, std::milli>(timeout),
+                       [this] { return impl_->running || impl_->finished; });
+    return impl_->running;
+}
+
+std::vector<ServiceStatistics>
+ModuleServerHandle::statistics() const {
+    std::vector<ServiceStatistics> summaries;
+    if(!impl_) {
+        return summaries;
+    }
+    std::lock_guard<std::mutex> lock(impl_->mutex);
+    summaries.reserve(impl_->stats.size());
+    for(const auto &s : impl_->stats) {
+        summaries.push_back(s->summary());
+    }
+    return summaries;
 }
 
-}  // namespace swapit
\ No newline at end of file
+}  // namespace swapit
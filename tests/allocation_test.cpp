@@ -0,0 +1,156 @@
+// Checks that accepting and running a call of an async service does not
+// allocate once the queues, the argument pool and the buffers have grown.
+//
+// The calls go through the method callback of the service: the validation of
+// the call, the result message, the copy of its arguments, the queueing of the
+// task, the callback and the queueing of its completion are covered. The
+// method result and the event are allocated by open62541 with malloc, which
+// is not counted: the result once per call, when create_sync_result copies it
+// into the output variant that open62541 owns, and the event when it is
+// emitted. The sync, deferred and batch paths allocate per call by design and
+// are not covered.
+#include "module_server.cpp"
+
+#include <cstdlib>
+
+// Counts the heap allocations of all threads.
+static std::atomic<size_t> allocations = 0;
+
+void *
+operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void
+operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace swapit {
+namespace {
+
+// More calls than the concurrency limit, so that most of them are deferred
+// by the limiter.
+constexpr size_t calls_per_round = 64;
+constexpr int warm_up_rounds = 4;
+constexpr int measured_rounds = 16;
+
+struct ServerDeleter {
+    void
+    operator()(UA_Server *server) const noexcept {
+        UA_Server_delete(server);
+    }
+};
+
+// The variants point into the struct, so it must not be moved.
+struct Inputs {
+    UA_PfdlBoolean flag = {true};
+    UA_PfdlNumber amount = {42.0};
+    std::string part_value = "an argument of a typical length";
+    UA_PfdlString part = {ua_string(part_value)};
+    std::array<UA_Variant, 3> variants = {};
+    std::vector<Parameter> params = {{"flag", PfdlType::boolean},
+                                     {"amount", PfdlType::number},
+                                     {"part", PfdlType::string}};
+
+    Inputs() {
+        UA_Variant_setScalar(&variants[0], &flag,
+                             get_struct_data_type(PfdlType::boolean));
+        UA_Variant_setScalar(&variants[1], &amount,
+                             get_struct_data_type(PfdlType::number));
+        UA_Variant_setScalar(&variants[2], &part,
+                             get_struct_data_type(PfdlType::string));
+    }
+
+    Inputs(const Inputs &) = delete;
+    Inputs &
+    operator=(const Inputs &) = delete;
+};
+
+// Calls the service calls_per_round times and waits until the calls ran.
+// Returns the number of allocations meanwhile.
+size_t
+run_round(AsyncService &service, const Inputs &in, TaskTracker &tasks) {
+    const size_t start = allocations.load();
+    for(size_t i = 0; i < calls_per_round; ++i) {
+        UA_Variant output = {};
+        service(in.variants.data(), in.variants.size(), &output);
+        auto *result =
+            static_cast<UA_ServiceExecutionAsyncResultDataType *>(output.data);
+        UA_StatusCode status = result->serviceResultCode;
+        UA_Variant_clear(&output);
+        if(status != UA_STATUSCODE_GOOD) {
+            throw BadStatusError(status);
+        }
+    }
+    tasks.wait_idle();
+    return allocations.load() - start;
+}
+
+int
+run() {
+    std::unique_ptr<UA_Server, ServerDeleter> server(UA_Server_new());
+    Namespaces ns =
+        add_namespaces(server.get(), "http://swap.demo.scenarios.fraunhofer.de/test");
+    Inputs in;
+
+    // Keep member order!
+    WorkerPool workers(2);
+    Signal signal;
+    CompletionQueue completions(server.get(), &signal);
+    TaskTracker tasks;
+    ServiceContext context{workers, completions, tasks};
+    ServiceDescription descr;
+    descr.name = "TestService";
+    descr.input_params = in.params;
+    descr.output_param = {"result", PfdlType::boolean};
+    descr.max_concurrency = 1;
+    descr.callback =
+        [](const std::vector<ArgumentView> &) -> std::optional<PfdlVariant> {
+        return true;
+    };
+    auto service = AsyncService::create(server.get(), ns, descr, context);
+
+    int failed_rounds = 0;
+    for(int round = 0; round < warm_up_rounds + measured_rounds; ++round) {
+        size_t n = run_round(*service, in, tasks);
+        // Emitting the events allocates and is not counted.
+        completions.drain();
+        if(round < warm_up_rounds) {
+            continue;
+        }
+        if(n != 0) {
+            std::cerr << "Round " << round << ": " << n << " allocations for "
+                      << calls_per_round << " calls." << std::endl;
+            ++failed_rounds;
+        }
+    }
+    if(failed_rounds != 0) {
+        return EXIT_FAILURE;
+    }
+    std::cerr << "No allocations in " << measured_rounds * calls_per_round
+              << " calls after warm-up." << std::endl;
+    return EXIT_SUCCESS;
+}
+
+}  // namespace
+}  // namespace swapit
+
+int
+main() {
+    try {
+        return swapit::run();
+    } catch(const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+    return EXIT_FAILURE;
+}